@@ -2,111 +2,155 @@
 
 #include <math.h>
 
+#include "clock.h"
 #include "dhcp.h"
 #include "logger.h"
+#include "stats.h"
 
-int block_alloc(ddhcp_block* block) {
+int block_alloc(ddhcp_block* block, ddhcp_config* config) {
   DEBUG("block_alloc(block)\n");
-  block->addresses = (struct dhcp_lease*) calloc(sizeof(struct dhcp_lease), block->subnet_len);
 
-  if (block->addresses == NULL) {
+  if (block->addresses) {
+    return 0;
+  }
+
+  uint64_t* slot = (uint64_t*) slab_alloc(&config->lease_slab);
+
+  if (slot == NULL) {
     return 1;
   }
 
+  memset(slot, 0, config->lease_slab.object_size);
+  block->lease_map = slot;
+  block->addresses = (struct dhcp_lease*)(slot + LEASE_MAP_WORDS(block->subnet_len));
+
   for (unsigned int index = 0; index < block->subnet_len; index++) {
     block->addresses[index].state = FREE;
     block->addresses[index].lease_end = 0;
+    block->addresses[index].block = block;
+    block->lease_map[index / 64] |= ((uint64_t) 1) << (index % 64);
   }
 
+  block->leases_free = block->subnet_len;
+  block->leases_offered = 0;
+  block->leases_leased = 0;
+
   return 0;
 }
 
-int block_own(ddhcp_block* block) {
-  if (block_alloc(block)) {
+void block_set_state(ddhcp_block* block, enum ddhcp_block_state state, ddhcp_config* config) {
+  block_page* page = block_page_of(block);
+  uint32_t slot = block->index & (BLOCK_TABLE_PAGE_SIZE - 1);
+  enum ddhcp_block_state previous = (enum ddhcp_block_state) page->states[slot];
+
+  if (previous == state) {
+    return;
+  }
+
+  if (state == DDHCP_FREE) {
+    freemap_set(&config->free_blocks, block->index);
+  } else if (previous == DDHCP_FREE) {
+    freemap_clear(&config->free_blocks, block->index);
+  }
+
+  if (state == DDHCP_OURS) {
+    list_add_tail(&block->owned_list, &config->owned_blocks);
+    config->num_owned_blocks++;
+    config->num_leases[FREE] += block->leases_free;
+    config->num_leases[OFFERED] += block->leases_offered;
+    config->num_leases[LEASED] += block->leases_leased;
+  } else if (previous == DDHCP_OURS) {
+    list_del(&block->owned_list);
+    config->num_owned_blocks--;
+    config->num_leases[FREE] -= block->leases_free;
+    config->num_leases[OFFERED] -= block->leases_offered;
+    config->num_leases[LEASED] -= block->leases_leased;
+  }
+
+  config->num_blocks[previous]--;
+  config->num_blocks[state]++;
+  page->states[slot] = state;
+
+  if (state == DDHCP_FREE || state == DDHCP_BLOCKED) {
+    timer_cancel(&config->block_timeouts, &block->timeout_node);
+  } else {
+    timer_schedule(&config->block_timeouts, &block->timeout_node, page->timeouts[slot]);
+  }
+}
+
+void block_set_timeout(ddhcp_block* block, time_t timeout, ddhcp_config* config) {
+  enum ddhcp_block_state state = block_state(block);
+  block_page_of(block)->timeouts[block->index & (BLOCK_TABLE_PAGE_SIZE - 1)] = timeout;
+
+  if (state != DDHCP_FREE && state != DDHCP_BLOCKED) {
+    timer_schedule(&config->block_timeouts, &block->timeout_node, timeout);
+  }
+}
+
+int block_own(ddhcp_block* block, ddhcp_config* config) {
+  if (block_alloc(block, config)) {
     return 1;
   } else {
-    block->state = DDHCP_OURS;
+    block_set_state(block, DDHCP_OURS, config);
     return 0;
   }
 }
 
-void block_free(ddhcp_block* block) {
+void block_free(ddhcp_block* block, ddhcp_config* config) {
   DEBUG("block_free(%i)\n", block->index);
 
-  if (block->state == DDHCP_OURS) {
-    block->state = DDHCP_FREE;
+  if (block_state(block) == DDHCP_OURS) {
+    block_set_state(block, DDHCP_FREE, config);
   }
 
   if (block->addresses) {
     DEBUG("Free DHCP leases for Block %i\n", block->index);
-    free(block->addresses);
+
+    dhcp_forget_leases(block, config);
+
+    slab_release(&config->lease_slab, block->lease_map);
     block->addresses = NULL;
+    block->lease_map = NULL;
   }
 }
 
-ddhcp_block* block_find_free(ddhcp_block* blocks, ddhcp_config* config) {
+ddhcp_block* block_find_free(block_table* blocks, ddhcp_config* config) {
   DEBUG("block_find_free(blocks,config)\n");
-  ddhcp_block* block = blocks;
-
-  ddhcp_block_list free_blocks, *tmp;
-  INIT_LIST_HEAD(&free_blocks.list);
-  uint32_t num_free_blocks = 0;
-
-  for (uint32_t i = 0; i < config->number_of_blocks; i++) {
-    if (block->state == DDHCP_FREE) {
-      tmp = (ddhcp_block_list*) malloc(sizeof(ddhcp_block_list));
-      tmp->block = block;
-      list_add_tail((&tmp->list), &(free_blocks.list));
-      num_free_blocks++;
-    }
-
-    block++;
-  }
+  uint32_t num_free_blocks = config->free_blocks.count;
 
   DEBUG("block_find_free(...): found %i free blocks\n", num_free_blocks);
 
-  ddhcp_block* random_free = NULL;
-  int r = -1;
-
-  if (num_free_blocks > 0) {
-    r = rand() % num_free_blocks;
-  } else {
+  if (num_free_blocks == 0) {
     DEBUG("block_find_free(...) -> no free block found\n");
     return NULL;
   }
 
-  struct list_head* pos, *q;
-
-  list_for_each_safe(pos, q, &free_blocks.list) {
-    tmp = list_entry(pos, ddhcp_block_list, list);
-    block = tmp->block;
-    list_del(pos);
-    free(tmp);
-
-    if (r == 0) {
-      random_free = block;
-    }
+  uint32_t r = rand() % num_free_blocks;
+  ddhcp_block* random_free = block_table_get(blocks, freemap_select(&config->free_blocks, r), config);
 
-    r--;
+  if (random_free == NULL) {
+    DEBUG("block_find_free(...) -> block can't be populated\n");
+    return NULL;
   }
 
   DEBUG("block_find_free(...)-> block %i\n", random_free->index);
   return random_free;
 }
 
-int block_claim(ddhcp_block* blocks, int num_blocks, ddhcp_config* config) {
+int block_claim(block_table* blocks, int num_blocks, ddhcp_config* config) {
   DEBUG("block_claim(blocks, %i, config)\n", num_blocks);
+  stats.claim_rounds++;
 
   // Handle blocks already in claiming prozess
   struct list_head* pos, *q;
-  time_t now = time(NULL);
+  time_t now = clock_now();
 
   list_for_each_safe(pos, q, &(config->claiming_blocks).list) {
     ddhcp_block_list* tmp = list_entry(pos, ddhcp_block_list, list);
     ddhcp_block* block = tmp->block;
 
     if (block->claiming_counts == 3) {
-      block_own(block);
+      block_own(block, config);
 
       // TODO Error Handling
 
@@ -114,11 +158,13 @@ int block_claim(ddhcp_block* blocks, int num_blocks, ddhcp_config* config) {
       num_blocks--;
 
       INFO("Block %i claimed after 3 claims.\n", block->index);
+      stats.claims_won++;
       list_del(pos);
       config->claiming_blocks_amount--;
       free(tmp);
-    } else if (block->state != DDHCP_CLAIMING) {
+    } else if (block_state(block) != DDHCP_CLAIMING) {
       DEBUG("block_claim(...): block %i is no longer marked as claiming\n", block->index);
+      stats.claims_lost++;
       list_del(pos);
       config->claiming_blocks_amount--;
       free(tmp);
@@ -138,9 +184,9 @@ int block_claim(ddhcp_block* blocks, int num_blocks, ddhcp_config* config) {
 
         // TODO Error Handling
 
-        block->state = DDHCP_CLAIMING;
+        block_set_state(block, DDHCP_CLAIMING, config);
         block->claiming_counts = 0;
-        block->timeout = now + config->tentative_timeout;
+        block_set_timeout(block, now + config->tentative_timeout, config);
         list->block = block;
         list_add_tail(&(list->list), &(config->claiming_blocks.list));
         config->claiming_blocks_amount++;
@@ -181,117 +227,96 @@ int block_claim(ddhcp_block* blocks, int num_blocks, ddhcp_config* config) {
     index++;
   }
 
-  send_packet_mcast(packet, config->mcast_socket, config->mcast_scope_id);
+  send_packet_mcast(packet, config->mcast_socket, config->mcast_scope_id, &config->tx_queue);
 
   free(packet->payload);
   free(packet);
   return 0;
 }
 
-int block_num_free_leases(ddhcp_block* block, ddhcp_config* config) {
-  DEBUG("block_num_free_leases(blocks, config)\n");
-  int free_leases = 0;
-#if LOG_LEVEL >= LOG_DEBUG
-  int num_blocks = 0;
-#endif
-
-  for (uint32_t i = 0; i < config->number_of_blocks; i++) {
-    if (block->state == DDHCP_OURS) {
-      free_leases += dhcp_num_free(block);
-#if LOG_LEVEL >= LOG_DEBUG
-      num_blocks++;
-#endif
-    }
-
-    block++;
-  }
+int block_num_free_leases(ddhcp_config* config) {
+  DEBUG("block_num_free_leases(config)\n");
+  int free_leases = config->num_leases[FREE];
 
-  DEBUG("block_num_free_leases(...)-> Found %i free dhcp leases in OUR (%i) blocks\n", free_leases, num_blocks);
+  DEBUG("block_num_free_leases(...)-> Found %i free dhcp leases in OUR (%u) blocks\n", free_leases, config->num_owned_blocks);
   return free_leases;
 }
 
-void block_update_claims(ddhcp_block* blocks, int blocks_needed, ddhcp_config* config) {
-  DEBUG("block_update_claims(blocks, %i, config)\n", blocks_needed);
+time_t block_update_claims(int blocks_needed, ddhcp_config* config) {
+  DEBUG("block_update_claims(%i, config)\n", blocks_needed);
   unsigned int our_blocks = 0;
-  ddhcp_block* block = blocks;
-  time_t now = time(NULL);
+  ddhcp_block* block, *tmp;
+  time_t now = clock_now();
   int timeout_half = floor((double) config->block_timeout / 2);
   int blocks_needed_tmp = blocks_needed;
+  time_t next_update = 0;
 
-  // TODO Use a linked list instead of processing the block list twice.
-  for (uint32_t i = 0; i < config->number_of_blocks; i++) {
-    if (block->state == DDHCP_OURS && block->timeout < now + timeout_half) {
-      if (blocks_needed_tmp < 0 && dhcp_num_free(block) == config->block_size) {
-        DEBUG("block_update_claims(...): block %i no longer needed\n", block->index);
-        blocks_needed_tmp--;
-        block_free(block);
-      } else {
-        our_blocks++;
-      }
-    }
-
-    block++;
-  }
-
-  if (our_blocks == 0) {
+  if (config->num_owned_blocks == 0) {
     DEBUG("block_update_claims(...)-> No blocks need claim update.\n");
-    return;
+    return 0;
   }
 
   struct ddhcp_mcast_packet* packet = new_ddhcp_packet(DDHCP_MSG_UPDATECLAIM, config);
 
-  packet->count = our_blocks;
-
-  packet->payload = (struct ddhcp_payload*) calloc(sizeof(struct ddhcp_payload), our_blocks);
+  // Allocate for all our blocks, only those with a timeout are filled in.
+  packet->payload = (struct ddhcp_payload*) calloc(sizeof(struct ddhcp_payload), config->num_owned_blocks);
 
   // TODO Check we actually got the memory
 
-  int index = 0;
+  list_for_each_entry_safe(block, tmp, &config->owned_blocks, owned_list) {
+    if (block_timeout(block) >= now + timeout_half) {
+      // The claim is updated, once less than half of its timeout is left.
+      if (next_update == 0 || block_timeout(block) - timeout_half + 1 < next_update) {
+        next_update = block_timeout(block) - timeout_half + 1;
+      }
 
-  block = blocks;
+      continue;
+    }
 
-  for (uint32_t i = 0; i < config->number_of_blocks; i++) {
-    if (block->state == DDHCP_OURS && block->timeout < now + timeout_half) {
-      packet->payload[index].block_index = block->index;
-      packet->payload[index].timeout     = config->block_timeout;
-      packet->payload[index].reserved    = 0;
-      index++;
-      block->timeout = now + config->block_timeout;
-      DEBUG("block_update_claims(...): update claim for block %i\n", block->index);
+    if (blocks_needed_tmp < 0 && dhcp_num_free(block) == config->block_size) {
+      DEBUG("block_update_claims(...): block %i no longer needed\n", block->index);
+      blocks_needed_tmp--;
+      block_free(block, config);
+      continue;
     }
 
-    block++;
+    packet->payload[our_blocks].block_index = block->index;
+    packet->payload[our_blocks].timeout     = config->block_timeout;
+    packet->payload[our_blocks].reserved    = 0;
+    our_blocks++;
+    block_set_timeout(block, now + config->block_timeout, config);
+    DEBUG("block_update_claims(...): update claim for block %i\n", block->index);
+
+    if (next_update == 0 || block_timeout(block) - timeout_half + 1 < next_update) {
+      next_update = block_timeout(block) - timeout_half + 1;
+    }
   }
 
-  send_packet_mcast(packet, config->mcast_socket, config->mcast_scope_id);
+  if (our_blocks == 0) {
+    DEBUG("block_update_claims(...)-> No blocks need claim update.\n");
+  } else {
+    packet->count = our_blocks;
+    send_packet_mcast(packet, config->mcast_socket, config->mcast_scope_id, &config->tx_queue);
+  }
 
   free(packet->payload);
   free(packet);
-}
 
-void block_check_timeouts(ddhcp_block* blocks, ddhcp_config* config) {
-  DEBUG("block_check_timeouts(blocks, config)\n");
-  ddhcp_block* block = blocks;
-  time_t now = time(NULL);
-
-  for (uint32_t i = 0; i < config->number_of_blocks; i++) {
-    if (block->timeout < now && block->state != DDHCP_BLOCKED && block->state != DDHCP_FREE) {
-      INFO("Block %i FREE throught timeout.\n", block->index);
-      block_free(block);
-    }
-
-    if (block->state == DDHCP_OURS) {
-      dhcp_check_timeouts(block);
-    } else if (block->addresses != NULL) {
-      int free_leases = dhcp_check_timeouts(block);
+  return next_update;
+}
 
-      if (free_leases == block->subnet_len) {
-        block_free(block);
-      }
-    }
+void block_check_timeouts(ddhcp_config* config) {
+  DEBUG("block_check_timeouts(config)\n");
+  time_t now = clock_now();
+  timer_node* node;
 
-    block++;
+  while ((node = timer_pop_expired(&config->block_timeouts, now)) != NULL) {
+    ddhcp_block* block = container_of(node, ddhcp_block, timeout_node);
+    INFO("Block %i FREE throught timeout.\n", block->index);
+    block_free(block, config);
   }
+
+  dhcp_check_timeouts(config);
 }
 
 void block_free_claims(ddhcp_config* config) {
@@ -308,18 +333,26 @@ void block_free_claims(ddhcp_config* config) {
   }
 }
 
-void block_show_status(int fd, ddhcp_block* blocks,  ddhcp_config* config) {
-  ddhcp_block* block = blocks;
+void block_show_status(int fd, block_table* blocks,  ddhcp_config* config) {
   dprintf(fd, "index,state,owner,claim_count,leases,timeout\n");
 
   for (uint32_t i = 0; i < config->number_of_blocks; i++) {
+    block_page* page = blocks->pages[i >> BLOCK_TABLE_PAGE_SHIFT];
+    uint32_t slot = i & (BLOCK_TABLE_PAGE_SIZE - 1);
+
+    if (page == NULL) {
+      // Untouched blocks are FREE.
+      dprintf(fd, "%u,%i,%s,%u,%u,%lu\n", i, DDHCP_FREE, "<id>", 0, 0, 0UL);
+      continue;
+    }
+
+    ddhcp_block* block = page->blocks + slot;
     uint32_t free_leases = 0;
 
     if (block->addresses != NULL) {
       free_leases = dhcp_num_free(block);
     }
 
-    dprintf(fd, "%i,%i,%s,%u,%u,%lu\n", block->index, block->state, "<id>" , block->claiming_counts, free_leases, block->timeout);
-    block++;
+    dprintf(fd, "%i,%i,%s,%u,%u,%lu\n", block->index, page->states[slot], "<id>" , block->claiming_counts, free_leases, page->timeouts[slot]);
   }
 }
@@ -2,56 +2,76 @@
 #define _BLOCK_H
 
 #include "types.h"
+#include "block_table.h"
 #include "packet.h"
 
 /**
  * Allocate block.
- * This will also malloc and prepare a dhcp_lease_block inside the given block.
+ * This will also take a dhcp_lease_block from the lease slab of the
+ * configuration and prepare it inside the given block.
  */
-int block_alloc(ddhcp_block* block);
+int block_alloc(ddhcp_block* block, ddhcp_config* config);
+
+/**
+ * Change the state of a block and keep the block indices of the
+ * configuration in sync. Every state transition has to pass through here.
+ */
+void block_set_state(ddhcp_block* block, enum ddhcp_block_state state, ddhcp_config* config);
+
+/**
+ * Change the timeout of a block and reschedule it in the block timeouts
+ * of the configuration.
+ */
+void block_set_timeout(ddhcp_block* block, time_t timeout, ddhcp_config* config);
 
 /**
  * Own a block, possibly after you have claimed it an amount of times.
- * This will also malloc and prepare a dhcp_lease_block inside the given block.
+ * This will also allocate and prepare a dhcp_lease_block inside the given block.
  */
-int block_own(ddhcp_block* block);
+int block_own(ddhcp_block* block, ddhcp_config* config);
 
 /**
  * Free a block and release dhcp_lease_block when allocated.
  */
-void block_free(ddhcp_block* block);
+void block_free(ddhcp_block* block, ddhcp_config* config);
 
 /**
  * Find a free block and return it or otherwise null.
  * A block is called free, when no other node claims it.
+ * The block is picked at random from the free block index of config.
  */
-ddhcp_block* block_find_free(ddhcp_block* blocks, ddhcp_config* config);
+ddhcp_block* block_find_free(block_table* blocks, ddhcp_config* config);
 
 /**
  * Claim a block! A block is only claimable when it is free.
  * Returns a value greater 0 if something goes sideways.
  */
-int block_claim(ddhcp_block* blocks, int num_blocks , ddhcp_config* config);
+int block_claim(block_table* blocks, int num_blocks , ddhcp_config* config);
 
 /**
  * Sum the number of free leases in blocks you own.
  */
-int block_num_free_leases(ddhcp_block* block, ddhcp_config* config);
+int block_num_free_leases(ddhcp_config* config);
 
 /**
  *  Update the timeout of claimed blocks and send packets to
  *  distribute the continuations of that claim.
+ *  Only the blocks in the owned block list of config are visited.
  *
  *  Due to fragmented timeouts this packet may send 2 times more packets
  *  than optimal. TODO fixthis
+ *
+ *  Returns the time the next claim update is due or 0 iff we own no blocks.
  */
-void block_update_claims(ddhcp_block* blocks, int blocks_needed, ddhcp_config* config);
+time_t block_update_claims(int blocks_needed, ddhcp_config* config);
 
 /**
  * Check the timeout of all blocks, and mark timed out once as FREE.
  * Blocks which are marked as BLOCKED are ignored in this process.
+ * Only the expired blocks are visited, they are taken from the
+ * block timeouts of the configuration. Afterwards expired leases are freed.
  */
-void block_check_timeouts(ddhcp_block* blocks, ddhcp_config* config);
+void block_check_timeouts(ddhcp_config* config);
 
 /**
  * Free block claim list structure.
@@ -61,6 +81,6 @@ void block_free_claims(ddhcp_config* config);
 /**
  * Show Block Status
  */
-void block_show_status(int fd, ddhcp_block* blocks,  ddhcp_config* config);
+void block_show_status(int fd, block_table* blocks,  ddhcp_config* config);
 
 #endif
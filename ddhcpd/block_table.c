@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "block.h"
+#include "block_table.h"
+#include "clock.h"
+#include "logger.h"
+#include "tools.h"
+
+static block_page* _block_table_populate(block_table* table, uint32_t page, ddhcp_config* config) {
+  DEBUG("_block_table_populate(table, %u)\n", page);
+  block_page* blocks = (block_page*) calloc(sizeof(block_page), 1);
+
+  if (!blocks) {
+    ERROR("_block_table_populate(...) -> Unable to allocate memory\n");
+    return NULL;
+  }
+
+  time_t now = clock_now();
+  uint32_t first = page << BLOCK_TABLE_PAGE_SHIFT;
+
+  for (uint32_t i = 0; i < BLOCK_TABLE_PAGE_SIZE && first + i < table->number_of_blocks; i++) {
+    ddhcp_block* block = blocks->blocks + i;
+    block->index = first + i;
+    addr_add(&config->prefix, &block->subnet, block->index * config->block_size);
+    block->subnet_len = config->block_size;
+    blocks->states[i] = DDHCP_FREE;
+    blocks->timeouts[i] = now + config->block_timeout;
+  }
+
+  table->pages[page] = blocks;
+  table->num_populated++;
+
+  return blocks;
+}
+
+int block_table_init(block_table* table, ddhcp_config* config) {
+  table->number_of_blocks = config->number_of_blocks;
+  table->num_pages = (config->number_of_blocks + BLOCK_TABLE_PAGE_SIZE - 1) >> BLOCK_TABLE_PAGE_SHIFT;
+  table->num_populated = 0;
+  table->pages = (block_page**) calloc(sizeof(block_page*), table->num_pages);
+
+  if (!table->pages) {
+    ERROR("block_table_init(...) -> Unable to allocate memory\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+void block_table_free(block_table* table, ddhcp_config* config) {
+  DEBUG("block_table_free(table, config) -> %u of %u pages populated\n", table->num_populated, table->num_pages);
+
+  for (uint32_t page = 0; page < table->num_pages; page++) {
+    block_page* blocks = table->pages[page];
+
+    if (!blocks) {
+      continue;
+    }
+
+    uint32_t first = page << BLOCK_TABLE_PAGE_SHIFT;
+
+    for (uint32_t i = 0; i < BLOCK_TABLE_PAGE_SIZE && first + i < table->number_of_blocks; i++) {
+      block_free(blocks->blocks + i, config);
+      // Blocks of other nodes are still scheduled.
+      timer_cancel(&config->block_timeouts, &blocks->blocks[i].timeout_node);
+    }
+
+    free(blocks);
+  }
+
+  free(table->pages);
+  table->pages = NULL;
+  table->num_pages = 0;
+  table->num_populated = 0;
+}
+
+ddhcp_block* block_table_find(block_table* table, uint32_t index) {
+  if (index >= table->number_of_blocks) {
+    return NULL;
+  }
+
+  block_page* blocks = table->pages[index >> BLOCK_TABLE_PAGE_SHIFT];
+
+  if (!blocks) {
+    return NULL;
+  }
+
+  return blocks->blocks + (index & (BLOCK_TABLE_PAGE_SIZE - 1));
+}
+
+ddhcp_block* block_table_get(block_table* table, uint32_t index, ddhcp_config* config) {
+  if (index >= table->number_of_blocks) {
+    return NULL;
+  }
+
+  block_page* blocks = table->pages[index >> BLOCK_TABLE_PAGE_SHIFT];
+
+  if (!blocks) {
+    blocks = _block_table_populate(table, index >> BLOCK_TABLE_PAGE_SHIFT, config);
+
+    if (!blocks) {
+      return NULL;
+    }
+  }
+
+  return blocks->blocks + (index & (BLOCK_TABLE_PAGE_SIZE - 1));
+}
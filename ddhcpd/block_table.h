@@ -0,0 +1,78 @@
+#ifndef _BLOCK_TABLE_H
+#define _BLOCK_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "list.h"
+#include "types.h"
+
+// Number of blocks in one page of the table, as a power of two.
+#define BLOCK_TABLE_PAGE_SHIFT 8
+#define BLOCK_TABLE_PAGE_SIZE (1 << BLOCK_TABLE_PAGE_SHIFT)
+
+/**
+ * A page of the block table. The fields read by scans over many blocks are
+ * packed into arrays in front of the per block metadata.
+ */
+struct block_page {
+  uint8_t states[BLOCK_TABLE_PAGE_SIZE];
+  time_t timeouts[BLOCK_TABLE_PAGE_SIZE];
+  ddhcp_block blocks[BLOCK_TABLE_PAGE_SIZE];
+};
+typedef struct block_page block_page;
+
+/**
+ * A paged table of all blocks of the network. Blocks which were never
+ * touched are implicitly FREE and have no memory, the page holding a
+ * block is allocated the first time the block is needed. Pages are kept
+ * until the table is freed, so pointers to blocks stay valid.
+ */
+struct block_table {
+  block_page** pages;
+  uint32_t num_pages;
+  uint32_t num_populated;
+  uint32_t number_of_blocks;
+};
+typedef struct block_table block_table;
+
+/**
+ * Prepare an empty table for the blocks of config.
+ * Returns a value greater 0 on failure.
+ */
+int block_table_init(block_table* table, ddhcp_config* config);
+
+/**
+ * Free all populated blocks and release the pages of the table.
+ */
+void block_table_free(block_table* table, ddhcp_config* config);
+
+/**
+ * Return the block with index or NULL, iff the block was never touched
+ * and is therefore FREE.
+ */
+ddhcp_block* block_table_find(block_table* table, uint32_t index);
+
+/**
+ * Return the block with index, its page is populated when needed.
+ * Returns NULL iff index is out of range or the page can't be allocated.
+ */
+ddhcp_block* block_table_get(block_table* table, uint32_t index, ddhcp_config* config);
+
+/**
+ * Return the page which holds block.
+ */
+static inline block_page* block_page_of(ddhcp_block* block) {
+  ddhcp_block* first = block - (block->index & (BLOCK_TABLE_PAGE_SIZE - 1));
+  return container_of(first, block_page, blocks[0]);
+}
+
+static inline enum ddhcp_block_state block_state(ddhcp_block* block) {
+  return (enum ddhcp_block_state) block_page_of(block)->states[block->index & (BLOCK_TABLE_PAGE_SIZE - 1)];
+}
+
+static inline time_t block_timeout(ddhcp_block* block) {
+  return block_page_of(block)->timeouts[block->index & (BLOCK_TABLE_PAGE_SIZE - 1)];
+}
+
+#endif
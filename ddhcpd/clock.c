@@ -0,0 +1,15 @@
+#include "clock.h"
+#include "logger.h"
+
+time_t clock_cached = 0;
+
+void clock_update(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+    ERROR("clock_update() -> Unable to read the monotonic clock\n");
+    return;
+  }
+
+  clock_cached = ts.tv_sec;
+}
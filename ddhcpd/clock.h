@@ -0,0 +1,25 @@
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include <time.h>
+
+/**
+ * The clock of the daemon, seconds on CLOCK_MONOTONIC. The clock is read
+ * once per event loop round by clock_update(), all deadlines of a round
+ * are based on that value.
+ */
+extern time_t clock_cached;
+
+/**
+ * Return the time of the current event loop round.
+ */
+static inline time_t clock_now(void) {
+  return clock_cached;
+}
+
+/**
+ * Read the monotonic clock.
+ */
+void clock_update(void);
+
+#endif
@@ -2,8 +2,10 @@
 #include "logger.h"
 #include "block.h"
 #include "dhcp_options.h"
+#include "latency.h"
+#include "stats.h"
 
-int handle_command(int socket, uint8_t* buffer, int msglen, ddhcp_block* blocks, ddhcp_config* config) {
+int handle_command(int socket, uint8_t* buffer, int msglen, block_table* blocks, ddhcp_config* config) {
   // TODO Rethink command handling and command design
   config->block_size = config->block_size;
 
@@ -51,7 +53,7 @@ int handle_command(int socket, uint8_t* buffer, int msglen, ddhcp_block* blocks,
     dhcp_option* option = (dhcp_option*) calloc(sizeof(dhcp_option), 1);
     option->code = buffer[1];
     option->len = buffer[2];
-    printf("%i:%i\n", buffer[1], buffer[2]);
+    DEBUG("handle_command(...) -> set option %i:%i\n", buffer[1], buffer[2]);
     option->payload = (uint8_t*) calloc(sizeof(uint8_t), option->len);
 
     memcpy(option->payload, buffer + 3, option->len);
@@ -59,6 +61,42 @@ int handle_command(int socket, uint8_t* buffer, int msglen, ddhcp_block* blocks,
     set_option_in_store(&config->options, option);
     return 0;
 
+  case 4:
+    if (msglen != 2) {
+      DEBUG("handle_command(...) -> message length mismatch\n");
+      return -2;
+    }
+
+    if (logger_set_level((int8_t) buffer[1])) {
+      DEBUG("handle_command(...) -> log level %i not compiled in\n", (int8_t) buffer[1]);
+      dprintf(socket, "error: log level %i exceeds the compiled in level %i\n", (int8_t) buffer[1], LOG_LEVEL);
+      return 0;
+    }
+
+    DEBUG("handle_command(...) -> set log level %i\n", log_level);
+    dprintf(socket, "log level: %i\n", log_level);
+    return 0;
+
+  case 5:
+    if (msglen != 1) {
+      DEBUG("handle_command(...) -> message length mismatch\n");
+      return -2;
+    }
+
+    DEBUG("handle_command(...) -> show statistics\n");
+    stats_show(socket);
+    return 0;
+
+  case 6:
+    if (msglen != 1) {
+      DEBUG("handle_command(...) -> message length mismatch\n");
+      return -2;
+    }
+
+    DEBUG("handle_command(...) -> show latency histograms\n");
+    latency_show(socket);
+    return 0;
+
   default:
     WARNING("handle_command(...) -> unknown command\n");
   }
@@ -2,7 +2,8 @@
 #define _CONTROL_H
 
 #include "types.h"
+#include "block_table.h"
 
-int handle_command(int socket, uint8_t* buffer, int msglen, ddhcp_block* blocks, ddhcp_config* config);
+int handle_command(int socket, uint8_t* buffer, int msglen, block_table* blocks, ddhcp_config* config);
 
 #endif
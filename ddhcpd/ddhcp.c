@@ -1,11 +1,12 @@
 #include <assert.h>
 
 #include "ddhcp.h"
+#include "clock.h"
 #include "dhcp.h"
 #include "logger.h"
 #include "tools.h"
 
-int ddhcp_block_init(struct ddhcp_block** blocks, ddhcp_config* config) {
+int ddhcp_block_init(block_table* blocks, ddhcp_config* config) {
   assert(blocks);
 
   if (config->number_of_blocks < 1) {
@@ -14,38 +15,41 @@ int ddhcp_block_init(struct ddhcp_block** blocks, ddhcp_config* config) {
   }
 
   DEBUG("ddhcp_block_init( blocks, config)\n");
-  *blocks = (struct ddhcp_block*) calloc(sizeof(struct ddhcp_block), config->number_of_blocks);
 
-  if (! *blocks) {
+  // Blocks are populated on demand, untouched blocks are FREE.
+  if (block_table_init(blocks, config)) {
     FATAL("ddhcp_block_init(...)-> Can't allocate memory for block structure\n");
     return 1;
   }
 
-  time_t now = time(NULL);
-
-  // TODO Maybe we should allocate number_of_blocks dhcp_lease_blocks previous
-  //      and assign one here instead of NULL. Performance boost, Memory defrag?
-  struct ddhcp_block* block = *blocks;
-
-  for (uint32_t index = 0; index < config->number_of_blocks; index++) {
-    block->index = index;
-    block->state = DDHCP_FREE;
-    addr_add(&config->prefix, &block->subnet, index * config->block_size);
-    block->subnet_len = config->block_size;
-    memset(&block->owner_address, 0, sizeof(struct in6_addr));
-    block->timeout = now + config->block_timeout;
-    block->claiming_counts = 0;
-    block->addresses = NULL;
-    block++;
+  if (freemap_init(&config->free_blocks, config->number_of_blocks, 1)) {
+    FATAL("ddhcp_block_init(...)-> Can't allocate memory for free block index\n");
+    block_table_free(blocks, config);
+    return 1;
+  }
+
+  memset(config->num_blocks, 0, sizeof(config->num_blocks));
+  memset(config->num_leases, 0, sizeof(config->num_leases));
+  config->num_blocks[DDHCP_FREE] = config->number_of_blocks;
+
+  // Lease arrays are taken from a slab, which is sized for the spare blocks
+  // and the blocks in use, so claiming and freeing blocks reuses its slots.
+  size_t slot_size = sizeof(uint64_t) * LEASE_MAP_WORDS(config->block_size) + sizeof(struct dhcp_lease) * config->block_size;
+
+  if (slab_init(&config->lease_slab, slot_size, 2 * (config->spare_blocks_needed + 1))) {
+    FATAL("ddhcp_block_init(...)-> Can't allocate memory for lease slab\n");
+    freemap_free(&config->free_blocks);
+    block_table_free(blocks, config);
+    return 1;
   }
 
   return 0;
 }
 
-void ddhcp_block_process_claims(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
+void ddhcp_block_process_claims(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
   DEBUG("ddhcp_block_process_claims( blocks, packet, config )\n");
   assert(packet->command == 1);
-  time_t now = time(NULL);
+  time_t now = clock_now();
 
   for (unsigned int i = 0; i < packet->count; i++) {
     struct ddhcp_payload* claim = &packet->payload[i];
@@ -56,29 +60,35 @@ void ddhcp_block_process_claims(struct ddhcp_block* blocks, struct ddhcp_mcast_p
       continue;
     }
 
-    if (blocks[block_index].state == DDHCP_OURS) {
+    ddhcp_block* block = block_table_get(blocks, block_index, config);
+
+    if (!block) {
+      continue;
+    }
+
+    if (block_state(block) == DDHCP_OURS) {
       INFO("ddhcp_block_process_claims(...): node 0x%02x%02x%02x%02x%02x%02x%02x%02x claims our block %i\n", HEX_NODE_ID(packet->node_id), block_index);
       // TODO Decide when and if we reclaim this block
       //      Which node has more leases in this block, ..., who has the better node_id.
     } else {
       // TODO Save the connection details for the claiming node, so we can contact him, for dhcp actions.
-      blocks[block_index].state = DDHCP_CLAIMED;
-      blocks[block_index].timeout = now + claim->timeout;
+      block_set_state(block, DDHCP_CLAIMED, config);
+      block_set_timeout(block, now + claim->timeout, config);
+      memcpy(&block->owner_address, &packet->sender->sin6_addr, sizeof(struct in6_addr));
       #if LOG_LEVEL >= LOG_DEBUG
       char ipv6_sender[INET6_ADDRSTRLEN];
-      memcpy(&blocks[block_index].owner_address, &packet->sender->sin6_addr, sizeof(struct in6_addr));
       DEBUG("Register block to %s\n",
-            inet_ntop(AF_INET6, &blocks[block_index].owner_address, ipv6_sender, INET6_ADDRSTRLEN));
+            inet_ntop(AF_INET6, &block->owner_address, ipv6_sender, INET6_ADDRSTRLEN));
       #endif
       INFO("ddhcp_block_process_claims(...): node 0x%02x%02x%02x%02x%02x%02x%02x%02x claims block %i with ttl: %i\n", HEX_NODE_ID(packet->node_id), block_index, claim->timeout);
     }
   }
 }
 
-void ddhcp_block_process_inquire(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
+void ddhcp_block_process_inquire(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
   DEBUG("ddhcp_block_process_inquire( blocks, packet, config )\n");
   assert(packet->command == 2);
-  time_t now = time(NULL);
+  time_t now = clock_now();
 
   for (unsigned int i = 0; i < packet->count; i++) {
     struct ddhcp_payload* tmp = &packet->payload[i];
@@ -90,37 +100,45 @@ void ddhcp_block_process_inquire(struct ddhcp_block* blocks, struct ddhcp_mcast_
 
     INFO("ddhcp_block_process_inquire(...): node 0x%02x%02x%02x%02x%02x%02x%02x%02x inquires block %i\n", HEX_NODE_ID(packet->node_id), tmp->block_index);
 
-    if (blocks[tmp->block_index].state == DDHCP_OURS) {
+    ddhcp_block* block = block_table_get(blocks, tmp->block_index, config);
+
+    if (!block) {
+      continue;
+    }
+
+    if (block_state(block) == DDHCP_OURS) {
       // Update Claims
       INFO("ddhcp_block_process_inquire(...): block %i is ours notify network", tmp->block_index);
-      blocks[tmp->block_index].timeout = 0;
-      block_update_claims(blocks, 0, config);
-    } else if (blocks[tmp->block_index].state == DDHCP_CLAIMING) {
+      block_set_timeout(block, 0, config);
+      block_update_claims(0, config);
+    } else if (block_state(block) == DDHCP_CLAIMING) {
       INFO("ddhcp_block_process_inquire(...): we are interested in block %i also\n", tmp->block_index);
 
       // QUESTION Why do we need multiple states for the same process?
       if (NODE_ID_CMP(packet->node_id, config->node_id) > 0) {
         INFO("ddhcp_block_process_inquire(...): .. but other node wins.\n");
-        blocks[tmp->block_index].state = DDHCP_TENTATIVE;
-        blocks[tmp->block_index].timeout = now + config->tentative_timeout;
+        block_set_state(block, DDHCP_TENTATIVE, config);
+        block_set_timeout(block, now + config->tentative_timeout, config);
       }
 
       // otherwise keep inquiring, the other node should see our inquires and step back.
     } else {
       INFO("ddhcp_block_process_inquire(...): set block %i to tentative \n", tmp->block_index);
-      blocks[tmp->block_index].state = DDHCP_TENTATIVE;
-      blocks[tmp->block_index].timeout = now + config->tentative_timeout;
+      block_set_state(block, DDHCP_TENTATIVE, config);
+      block_set_timeout(block, now + config->tentative_timeout, config);
     }
   }
 }
 
-void ddhcp_dhcp_renewlease(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
+void ddhcp_dhcp_renewlease(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
   DEBUG("ddhcp_dhcp_renewlease(%li,%li,%li)\n", (long int) &blocks, (long int) &packet, (long int) &config);
 
   #if LOG_LEVEL >= LOG_DEBUG
-  char* hwaddr = hwaddr2c(packet->renew_payload->chaddr);
-  DEBUG("ddhcp_dhcp_renewlease( ... ): Request for xid: %u chaddr: %s\n",packet->renew_payload->xid,hwaddr);
-  free(hwaddr);
+  if (LOG_ENABLED(LOG_DEBUG)) {
+    char* hwaddr = hwaddr2c(packet->renew_payload->chaddr);
+    DEBUG("ddhcp_dhcp_renewlease( ... ): Request for xid: %u chaddr: %s\n",packet->renew_payload->xid,hwaddr);
+    free(hwaddr);
+  }
   #endif
 
   int ret = dhcp_rhdl_request(&(packet->renew_payload->address), blocks, config);
@@ -142,39 +160,40 @@ void ddhcp_dhcp_renewlease(struct ddhcp_block* blocks, struct ddhcp_mcast_packet
 
   answer->renew_payload = packet->renew_payload;
 
-  send_packet_direct(answer, &packet->sender->sin6_addr, config->server_socket, config->mcast_scope_id);
+  send_packet_direct(answer, &packet->sender->sin6_addr, config->server_socket, config->mcast_scope_id, &config->tx_queue);
   free(answer->renew_payload);
   free(answer);
 }
 
-void ddhcp_dhcp_leaseack(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* request, ddhcp_config* config) {
+void ddhcp_dhcp_leaseack(block_table* blocks, struct ddhcp_mcast_packet* request, ddhcp_config* config) {
   // Stub functions
   DEBUG("ddhcp_dhcp_leaseack(%li,%li,%li)\n", (long int) &blocks, (long int) &request, (long int) &config);
   #if LOG_LEVEL >= LOG_DEBUG
-  char* hwaddr = hwaddr2c(request->renew_payload->chaddr);
-  DEBUG("ddhcp_dhcp_leaseack( ... ): ACK for xid: %u chaddr: %s\n",request->renew_payload->xid,hwaddr);
-  free(hwaddr);
+  if (LOG_ENABLED(LOG_DEBUG)) {
+    char* hwaddr = hwaddr2c(request->renew_payload->chaddr);
+    DEBUG("ddhcp_dhcp_leaseack( ... ): ACK for xid: %u chaddr: %s\n",request->renew_payload->xid,hwaddr);
+    free(hwaddr);
+  }
   #endif
-  dhcp_packet_list* pkt_list = dhcp_packet_list_find(&config->dhcp_packet_cache, request->renew_payload->xid, request->renew_payload->chaddr);
+  dhcp_packet packet;
 
-  if (pkt_list == NULL) {
+  if (dhcp_cache_find(&config->dhcp_packet_cache, request->renew_payload->xid, request->renew_payload->chaddr, &packet)) {
     // Ignore packet
     DEBUG("ddhcp_dhcp_leaseack( ... ) -> No matching packet found, ignore message\n");
   } else {
-    dhcp_packet* packet = &pkt_list->packet;
     // Process packet
-    dhcp_rhdl_ack(config->client_socket, packet, blocks, config);
+    dhcp_rhdl_ack(config->client_socket, &packet, blocks, config);
   }
   free(request->renew_payload);
 }
 
-void ddhcp_dhcp_leasenak(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
+void ddhcp_dhcp_leasenak(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
   // Stub functions
   DEBUG("ddhcp_dhcp_leasenak(%li,%li,%li)\n", (long int) &blocks, (long int) &packet, (long int) &config);
   free(packet->renew_payload);
 }
 
-void ddhcp_dhcp_release(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
+void ddhcp_dhcp_release(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config) {
   DEBUG("ddhcp_dhcp_release(blocks,packet,config)\n");
   dhcp_release_lease(packet->renew_payload->address, blocks, config);
   free(packet->renew_payload);
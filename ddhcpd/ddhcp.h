@@ -4,19 +4,20 @@
 #include "types.h"
 #include "list.h"
 #include "block.h"
+#include "scheduler.h"
 
-int ddhcp_block_init(struct ddhcp_block** blocks, ddhcp_config* config);
+int ddhcp_block_init(block_table* blocks, ddhcp_config* config);
 
-void ddhcp_block_process_claims(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
-void ddhcp_block_process_inquire(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
+void ddhcp_block_process_claims(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
+void ddhcp_block_process_inquire(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
 
-void ddhcp_dhcp_renewlease(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
-void ddhcp_dhcp_leaseack(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
-void ddhcp_dhcp_leasenak(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
-void ddhcp_dhcp_release(struct ddhcp_block* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
+void ddhcp_dhcp_renewlease(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
+void ddhcp_dhcp_leaseack(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
+void ddhcp_dhcp_leasenak(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
+void ddhcp_dhcp_release(block_table* blocks, struct ddhcp_mcast_packet* packet, ddhcp_config* config);
 
-ddhcp_block* block_find_lease(ddhcp_block* blocks, ddhcp_config* config);
+ddhcp_block* block_find_lease(block_table* blocks, ddhcp_config* config);
 
-void house_keeping(ddhcp_block* blocks, ddhcp_config* config);
+void house_keeping(block_table* blocks, ddhcp_config* config, scheduler* sched);
 
 #endif
@@ -26,7 +26,7 @@ int main(int argc, char** argv) {
 #define BUFSIZE_MAX 1500
   uint8_t* buffer = (uint8_t*) calloc(sizeof(uint8_t), BUFSIZE_MAX);
 
-  while ((c = getopt(argc, argv, "C:t:bdho:")) != -1) {
+  while ((c = getopt(argc, argv, "C:t:bdhl:o:sL")) != -1) {
     switch (c) {
     case 'h':
       show_usage = 1;
@@ -44,6 +44,25 @@ int main(int argc, char** argv) {
       buffer[0] = (char) 2;
       break;
 
+    case 's':
+      // show statistics
+      msglen = 1;
+      buffer[0] = (char) 5;
+      break;
+
+    case 'L':
+      // show latency histograms
+      msglen = 1;
+      buffer[0] = (char) 6;
+      break;
+
+    case 'l':
+      // set log level
+      msglen = 2;
+      buffer[0] = (char) 4;
+      buffer[1] = (char) atoi(optarg);
+      break;
+
     case 'o':
       option = parse_option();
       break;
@@ -66,16 +85,20 @@ int main(int argc, char** argv) {
     buffer[0] = (char) 3;
     buffer[1] = (char) option->code;
     buffer[2] = (char) option->len;
-    memcpy(buffer + 3, option->payload, sizeof(option));
+    memcpy(buffer + 3, option->payload, option->len);
+    free(option->payload);
     free(option);
   }
 
   if (show_usage) {
-    printf("Usage: ddhcpctl [-h|-b|-d|-o <option>|-C PATH]\n");
+    printf("Usage: ddhcpctl [-h|-b|-d|-s|-L|-l LEVEL|-o <option>|-C PATH]\n");
     printf("\n");
     printf("-h                   This usage information.\n");
     printf("-b                   Show current block usage.\n");
     printf("-d                   Show the current dhcp options store.\n");
+    printf("-s                   Show message counters.\n");
+    printf("-L                   Show latency histograms of DHCP replies.\n");
+    printf("-l LEVEL             Set the log level (0 fatal, 5 error, 10 warning, 15 info, 20 debug).\n");
     printf("-o CODE;LEN;P1,..,Pn Set DHCP Option with code,len and #len chars in decimal\n");
     printf("-C PATH              Path to control socket\n");
     exit(0);
@@ -1,10 +1,12 @@
 #include <string.h>
 
 #include "block.h"
+#include "clock.h"
 #include "dhcp.h"
 #include "dhcp_options.h"
 #include "logger.h"
 #include "packet.h"
+#include "stats.h"
 #include "tools.h"
 
 // Free an offered lease after 12 seconds.
@@ -24,10 +26,11 @@ uint16_t DHCP_LEASE_SERVER_DELTA = 100;
  * Search for block and lease for given address, returns a status code and found
  * results.
  * A status code of 0 is returned, iff the result is in one of our blocks.
- * Of 1, iff result is non in our blocks.
+ * Of 1, iff result is non in our blocks. The block is NULL, iff it was
+ * never touched and thus is FREE.
  * And 2 on failure.
  */
-uint8_t find_lease_from_address(struct in_addr* addr, ddhcp_block* blocks, ddhcp_config* config, ddhcp_block** lease_block, uint32_t* lease_index) {
+uint8_t find_lease_from_address(struct in_addr* addr, block_table* blocks, ddhcp_config* config, ddhcp_block** lease_block, uint32_t* lease_index) {
 #if LOG_LEVEL >= LOG_DEBUG
   DEBUG("find_lease_from_address( %s, ...)\n", inet_ntoa(*addr));
 #endif
@@ -36,109 +39,172 @@ uint8_t find_lease_from_address(struct in_addr* addr, ddhcp_block* blocks, ddhcp
   uint32_t block_number = (ntohl(address) - ntohl((uint32_t) config->prefix.s_addr)) / config->block_size;
   uint32_t lease_number = (ntohl(address) - ntohl((uint32_t) config->prefix.s_addr)) % config->block_size;
 
-  if (block_number < config->number_of_blocks) {
-    DEBUG("find_lease_from_address(...) -> found block %i and lease %i with state %i \n", block_number, lease_number, blocks[block_number].state);
+  if (block_number >= config->number_of_blocks) {
+    DEBUG("find_lease_from_address(...) -> block index %i outside of configured of network structure\n", block_number);
+    return 2;
+  }
 
-    if (lease_block) {
-      *lease_block = blocks + block_number;
-    }
+  // A lookup never populates the block table, untouched blocks are FREE.
+  ddhcp_block* block = block_table_find(blocks, block_number);
 
-    if (lease_index) {
-      *lease_index = lease_number;
-    }
+  if (lease_block) {
+    *lease_block = block;
+  }
 
-    DEBUG("find_lease_from_address( ... ): state: %i\n", DDHCP_OURS);
+  if (lease_index) {
+    *lease_index = lease_number;
+  }
 
-    if (blocks[block_number].state == DDHCP_OURS) {
-      return 0;
-    } else {
-      // TODO Try to aquire address for client
-      return 1;
-    }
+  if (!block) {
+    DEBUG("find_lease_from_address(...) -> block %i is free\n", block_number);
+    return 1;
   }
 
-  DEBUG("find_lease_from_address(...) -> block index %i outside of configured of network structure\n", block_number);
+  DEBUG("find_lease_from_address(...) -> found block %i and lease %i with state %i \n", block_number, lease_number, block_state(block));
 
-  return 2;
+  if (block_state(block) == DDHCP_OURS) {
+    return 0;
+  } else {
+    // TODO Try to aquire address for client
+    return 1;
+  }
 }
 
-void _dhcp_release_lease(ddhcp_block* block , uint32_t lease_index) {
-  INFO("Releasing Lease %i in block %i\n", lease_index, block->index);
-  dhcp_lease* lease = block->addresses + lease_index;
+uint16_t* _dhcp_lease_counter(ddhcp_block* block, enum dhcp_lease_state state) {
+  switch (state) {
+  case OFFERED:
+    return &block->leases_offered;
 
-  // TODO Should we really reset the chaddr or xid, RFC says we
-  // ''SHOULD retain a record of the client's initialization parameters for possible reuse''
-  memset(lease->chaddr, 0, 16);
+  case LEASED:
+    return &block->leases_leased;
 
-  lease->xid   = 0;
-  lease->state = FREE;
+  case FREE:
+  default:
+    return &block->leases_free;
+  }
 }
 
-dhcp_packet* build_initial_packet(dhcp_packet* from_client) {
-  DEBUG("build_initial_packet( from_client, packet )\n");
+/**
+ * Change the state of a lease and keep the lease counters and the lease map
+ * of its block in sync. Every lease transition has to pass through here.
+ */
+void _dhcp_lease_set_state(ddhcp_block* block, dhcp_lease* lease, enum dhcp_lease_state state, ddhcp_config* config) {
+  if (lease->state == state) {
+    return;
+  }
+
+  uint32_t index = lease - block->addresses;
+  uint64_t bit = ((uint64_t) 1) << (index % 64);
+
+  if (state == FREE) {
+    block->lease_map[index / 64] |= bit;
+  } else {
+    block->lease_map[index / 64] &= ~bit;
+  }
+
+  (*_dhcp_lease_counter(block, lease->state))--;
+  (*_dhcp_lease_counter(block, state))++;
+
+  if (block_state(block) == DDHCP_OURS) {
+    config->num_leases[lease->state]--;
+    config->num_leases[state]++;
+  }
 
-  dhcp_packet* packet = (dhcp_packet*) calloc(sizeof(dhcp_packet), 1);
+  lease->state = state;
+}
 
-  if (packet == NULL) {
-    DEBUG("build_initial_packet(...) -> memory allocation failure\n");
-    return NULL;
+/**
+ * Remove a lease from the client indices, iff it is registered there.
+ * Leases which are not FREE are registered with their chaddr and xid.
+ */
+void _dhcp_lease_unindex(dhcp_lease* lease, ddhcp_config* config) {
+  if (lease->state == FREE) {
+    return;
   }
 
-  packet->op    = 2;
-  packet->htype = from_client->htype;
-  packet->hlen  = from_client->hlen;
-  packet->hops  = from_client->hops;
-  packet->xid   = from_client->xid;
-  packet->secs  = 0;
-  packet->flags = from_client->flags;
-  memcpy(&packet->ciaddr, &from_client->ciaddr, 4);
-  // yiaddr
-  // siaddr
-  memcpy(&packet->giaddr, &from_client->giaddr, 4);
-  memcpy(&packet->chaddr, &from_client->chaddr, 16);
-  // sname
-  // file
-  // options
-
-  return packet;
+  lease_index_remove(&config->lease_clients, lease);
+  lease_index_remove(&config->lease_requests, lease);
+}
+
+/**
+ * Register a client for a lease, move the lease into state and
+ * schedule its expiry.
+ */
+void _dhcp_lease_assign(ddhcp_block* block, uint32_t lease_index, enum dhcp_lease_state state, int8_t* chaddr, uint32_t xid, time_t lease_end, ddhcp_config* config) {
+  dhcp_lease* lease = block->addresses + lease_index;
+
+  _dhcp_lease_unindex(lease, config);
+
+  memcpy(&lease->chaddr, chaddr, 16);
+  lease->xid = xid;
+  lease->lease_end = lease_end;
+  _dhcp_lease_set_state(block, lease, state, config);
+  timer_schedule(&config->lease_timeouts, &lease->expiry_node, lease_end);
+
+  lease_index_insert(&config->lease_clients, lease);
+  lease_index_insert(&config->lease_requests, lease);
 }
 
-int dhcp_hdl_discover(int socket, dhcp_packet* discover, ddhcp_block* blocks, ddhcp_config* config) {
-  DEBUG("dhcp_discover( %i, packet, blocks, config)\n", socket);
+void _dhcp_release_lease(ddhcp_block* block , uint32_t lease_index, ddhcp_config* config) {
+  INFO("Releasing Lease %i in block %i\n", lease_index, block->index);
+  dhcp_lease* lease = block->addresses + lease_index;
+
+  _dhcp_lease_unindex(lease, config);
 
-  time_t now = time(NULL);
-  ddhcp_block* block = blocks;
+  // TODO Should we really reset the chaddr or xid, RFC says we
+  // ''SHOULD retain a record of the client's initialization parameters for possible reuse''
+  memset(lease->chaddr, 0, 16);
+
+  lease->xid   = 0;
+  _dhcp_lease_set_state(block, lease, FREE, config);
+  timer_cancel(&config->lease_timeouts, &lease->expiry_node);
+}
+
+int dhcp_hdl_discover(int socket, dhcp_packet* discover, ddhcp_config* config) {
+  DEBUG("dhcp_discover( %i, packet, config)\n", socket);
+
+  time_t now = clock_now();
+  ddhcp_block* block;
   dhcp_lease* lease = NULL;
   ddhcp_block* lease_block = NULL;
 
   int lease_index = 0;
   int lease_ratio = config->block_size + 1;
 
+  // A repeated discover gets the address offered before.
+  dhcp_lease* offered = dhcp_find_client_lease((uint8_t*) discover->chaddr, config);
+
+  if (offered && offered->state != OFFERED) {
+    offered = NULL;
+  }
+
+  if (offered) {
+    DEBUG("dhcp_discover(...) -> client was already offered a lease\n");
+    lease = offered;
+    lease_block = offered->block;
+    lease_index = offered - lease_block->addresses;
+  }
 
   // TODO Select Block according to usage, current behavior leads to fragmentation
   //      of block usage, if more that one block is claimed.
-  for (uint32_t i = 0; i < config->number_of_blocks; i++) {
-    if (block->state == DDHCP_OURS) {
-      int free_leases = dhcp_num_free(block);
+  list_for_each_entry(block, &config->owned_blocks, owned_list) {
+    int free_leases = dhcp_num_free(block);
 
-      if (free_leases > 0) {
-        DEBUG("dhcp_discover(...) -> block %i has %i free leases\n", block->index, free_leases);
+    if (!offered && free_leases > 0) {
+      DEBUG("dhcp_discover(...) -> block %i has %i free leases\n", block->index, free_leases);
 
-        if (free_leases < lease_ratio) {
-          DEBUG("dhcp_discover(...) -> block %i has best lease ratio until now\n", block->index);
+      if (free_leases < lease_ratio) {
+        DEBUG("dhcp_discover(...) -> block %i has best lease ratio until now\n", block->index);
 
-          uint32_t index = dhcp_get_free_lease(block);
+        uint32_t index = dhcp_get_free_lease(block);
 
-          lease_block = block;
-          lease_index = index;
-          lease_ratio = free_leases;
+        lease_block = block;
+        lease_index = index;
+        lease_ratio = free_leases;
 
-          lease = block->addresses + index;
-        }
+        lease = block->addresses + index;
       }
     }
-
-    block++;
   }
 
   if (! lease) {
@@ -146,46 +212,42 @@ int dhcp_hdl_discover(int socket, dhcp_packet* discover, ddhcp_block* blocks, dd
     return 2;
   }
 
-  dhcp_packet* packet = build_initial_packet(discover);
-
-  if (! packet) {
-    DEBUG("dhcp_discover(...) -> memory allocation failure");
-    return 1;
-  }
-
   // Mark lease as offered and register client
-  memcpy(&lease->chaddr, &discover->chaddr, 16);
-  lease->xid = discover->xid;
-  lease->state = OFFERED;
-  lease->lease_end = now + DHCP_OFFER_TIMEOUT;
+  _dhcp_lease_assign(lease_block, lease_index, OFFERED, discover->chaddr, discover->xid, now + DHCP_OFFER_TIMEOUT, config);
 
-  addr_add(&lease_block->subnet, &packet->yiaddr, lease_index);
+  dhcp_reply reply;
+  struct in_addr yiaddr;
+  dhcp_reply_init(&reply, txqueue_buffer(&config->tx_queue), TXQUEUE_BUFFER_SIZE, discover);
 
-  DEBUG("dhcp_discover(...) offering address %i %s\n", lease_index, inet_ntoa(lease_block->subnet));
+  addr_add(&lease_block->subnet, &yiaddr, lease_index);
+  dhcp_reply_yiaddr(&reply, &yiaddr);
 
-  // TODO We need a more extendable way to build up options
-  packet->options_len = fill_options(discover->options, discover->options_len, &config->options, 2, &packet->options) ;
+  DEBUG("dhcp_discover(...) offering address %i %s\n", lease_index, inet_ntoa(lease_block->subnet));
 
-  // TODO Error handling
-  set_option(packet->options, packet->options_len, DHCP_CODE_MESSAGE_TYPE, 1, (uint8_t[]) {
+  dhcp_reply_option(&reply, DHCP_CODE_MESSAGE_TYPE, 1, (uint8_t[]) {
     DHCPOFFER
   });
-  set_option(packet->options, packet->options_len, DHCP_CODE_ADDRESS_LEASE_TIME, 1, (uint8_t[]) {
+  stats_dhcp_sent(DHCPOFFER);
+  dhcp_reply_option(&reply, DHCP_CODE_ADDRESS_LEASE_TIME, 1, (uint8_t[]) {
     DHCP_LEASE_TIME
   });
 
-  dhcp_packet_send(socket, packet);
+  dhcp_option_blob* blob = fill_options(discover, &config->options);
+
+  if (blob) {
+    dhcp_reply_options(&reply, blob->data, blob->len);
+  }
 
-  free(packet->options);
-  free(packet);
+  dhcp_reply_send(socket, &reply, &config->tx_queue);
+  txqueue_stamp(&config->tx_queue, LATENCY_OFFER, &discover->received);
 
   return 0;
 }
 
-int dhcp_rhdl_request(uint32_t* address, ddhcp_block* blocks, ddhcp_config* config) {
+int dhcp_rhdl_request(uint32_t* address, block_table* blocks, ddhcp_config* config) {
   DEBUG("dhcp_rhdl_request(address, blocks, config)\n");
 
-  time_t now = time(NULL);
+  time_t now = clock_now();
   ddhcp_block* lease_block = NULL;
   uint32_t lease_index = 0;
   struct in_addr requested_address;
@@ -199,6 +261,11 @@ int dhcp_rhdl_request(uint32_t* address, ddhcp_block* blocks, ddhcp_config* conf
     // TODO Check for validity of request (chaddr)
     dhcp_lease* lease = lease_block->addresses + lease_index;
     lease->lease_end = now + DHCP_LEASE_TIME + DHCP_LEASE_SERVER_DELTA;
+
+    if (lease->state != FREE) {
+      timer_schedule(&config->lease_timeouts, &lease->expiry_node, lease->lease_end);
+    }
+
     // Report ack
     return 0;
   } else if (found == 1) {
@@ -210,13 +277,13 @@ int dhcp_rhdl_request(uint32_t* address, ddhcp_block* blocks, ddhcp_config* conf
   }
 }
 
-int dhcp_rhdl_ack(int socket, struct dhcp_packet* request, ddhcp_block* blocks, ddhcp_config* config) {
+int dhcp_rhdl_ack(int socket, struct dhcp_packet* request, block_table* blocks, ddhcp_config* config) {
 
   ddhcp_block* lease_block = NULL;
   uint32_t lease_index = 0;
   struct in_addr requested_address;
 
-  uint8_t* address = find_option_requested_address(request->options, request->options_len);
+  uint8_t* address = find_option_requested_address(request);
 
   if (address) {
     memcpy(&requested_address, address, sizeof(struct in_addr));
@@ -224,25 +291,30 @@ int dhcp_rhdl_ack(int socket, struct dhcp_packet* request, ddhcp_block* blocks,
     memcpy(&requested_address, &request->ciaddr.s_addr, sizeof(struct in_addr));
   }
 
-  if (find_lease_from_address(&requested_address, blocks, config, &lease_block, &lease_index) != 1) {
+  if (find_lease_from_address(&requested_address, blocks, config, &lease_block, &lease_index) != 1 || !lease_block) {
     DEBUG("dhcp_rhdl_ack( ... ) -> lease not found\n");
     return 1;
   }
 
-  return dhcp_ack(socket, request, lease_block, lease_index, config);
+  if (dhcp_ack(socket, request, lease_block, lease_index, config)) {
+    return 1;
+  }
+
+  txqueue_stamp(&config->tx_queue, LATENCY_ACK_REMOTE, &request->received);
+  return 0;
 }
 
-int dhcp_hdl_request(int socket, struct dhcp_packet* request, ddhcp_block* blocks, ddhcp_config* config) {
+int dhcp_hdl_request(int socket, struct dhcp_packet* request, block_table* blocks, ddhcp_config* config) {
   DEBUG("dhcp_hdl_request( %i, dhcp_packet, blocks, config)\n", socket);
 
   // search the lease we may have offered
 
-  time_t now = time(NULL);
+  time_t now = clock_now();
   dhcp_lease* lease = NULL ;
   ddhcp_block* lease_block = NULL;
   uint32_t lease_index = 0;
 
-  uint8_t* address = find_option_requested_address(request->options, request->options_len);
+  uint8_t* address = find_option_requested_address(request);
 
   struct in_addr requested_address;
   uint8_t found_address = 0;
@@ -259,15 +331,21 @@ int dhcp_hdl_request(int socket, struct dhcp_packet* request, ddhcp_block* block
     // Calculate block and dhcp_lease from address
     uint8_t found = find_lease_from_address(&requested_address, blocks, config, &lease_block, &lease_index);
 
+    if (found == 1 && !lease_block) {
+      // The block is free, nobody can hand out this lease.
+      DEBUG("dhcp_hdl_request(...): Requested lease is in a free block\n");
+      return 2;
+    }
+
     if (found != 2) {
       lease = lease_block->addresses + lease_index;
       DEBUG("dhcp_hdl_request(...): Lease found.\n");
 
-      if (lease_block->state == DDHCP_CLAIMED) {
+      if (block_state(lease_block) == DDHCP_CLAIMED) {
         if (lease_block->addresses == NULL) {
-          if (block_alloc(lease_block)) {
+          if (block_alloc(lease_block, config)) {
             ERROR("dhcp_hdl_request(...): can't allocate requested block");
-            dhcp_nack(socket, request);
+            dhcp_nack(socket, request, config);
           }
         }
 
@@ -276,10 +354,7 @@ int dhcp_hdl_request(int socket, struct dhcp_packet* request, ddhcp_block* block
         DEBUG("dhcp_hdl_request(...): Requested lease is owned by another node. Send Request.\n");
         // Register client information in lease
         // TODO This isn't a good idea, because of multi request on the same address from various clients, register it elsewhere and append xid.
-        lease->xid = request->xid;
-        lease->state = OFFERED;
-        lease->lease_end = now + DHCP_LEASE_TIME + DHCP_LEASE_SERVER_DELTA;
-        memcpy(&lease->chaddr, &request->chaddr, 16);
+        _dhcp_lease_assign(lease_block, lease_index, OFFERED, request->chaddr, request->xid, now + DHCP_LEASE_TIME + DHCP_LEASE_SERVER_DELTA, config);
 
         // Build packet and send it
         ddhcp_renew_payload payload;
@@ -288,9 +363,11 @@ int dhcp_hdl_request(int socket, struct dhcp_packet* request, ddhcp_block* block
         payload.xid = request->xid;
         payload.lease_seconds = 0;
         #if LOG_LEVEL >= LOG_DEBUG
-        char* hwaddr = hwaddr2c(payload.chaddr);
-        DEBUG("dhcp_hdl_request( ... ): Save request for xid: %u chaddr: %s\n",payload.xid,hwaddr);
-        free(hwaddr);
+        if (LOG_ENABLED(LOG_DEBUG)) {
+          char* hwaddr = hwaddr2c(payload.chaddr);
+          DEBUG("dhcp_hdl_request( ... ): Save request for xid: %u chaddr: %s\n",payload.xid,hwaddr);
+          free(hwaddr);
+        }
         #endif
 
         // Send packet
@@ -299,20 +376,20 @@ int dhcp_hdl_request(int socket, struct dhcp_packet* request, ddhcp_block* block
 
         // Store packet for later usage.
         // TODO Error handling
-        dhcp_packet_list_add(&config->dhcp_packet_cache,request);
+        dhcp_cache_add(&config->dhcp_packet_cache, request);
 
-        send_packet_direct(packet, &lease_block->owner_address, config->server_socket, config->mcast_scope_id);
+        send_packet_direct(packet, &lease_block->owner_address, config->server_socket, config->mcast_scope_id, &config->tx_queue);
         free(packet);
         return 2;
 
-      } else if (lease_block->state == DDHCP_OURS) {
+      } else if (block_state(lease_block) == DDHCP_OURS) {
         if (lease->state != OFFERED || lease->xid != request->xid) {
           if (memcmp(request->chaddr, lease->chaddr, 16) != 0) {
             // Check if lease is free
             if (lease->state != FREE) {
               DEBUG("dhcp_request(...): Requested lease offered to other client\n");
               // Send DHCP_NACK
-              dhcp_nack(socket, request);
+              dhcp_nack(socket, request, config);
               return 2;
             }
           }
@@ -324,47 +401,37 @@ int dhcp_hdl_request(int socket, struct dhcp_packet* request, ddhcp_block* block
       }
     }
   } else {
-    ddhcp_block* block = blocks;
+    dhcp_lease* lease_iter;
+    uint32_t cursor = LEASE_INDEX_START;
 
     // Find lease from xid
-    for (uint32_t i = 0; i < config->number_of_blocks; i++) {
-      if (block->state == DDHCP_OURS) {
-        dhcp_lease* lease_iter = block->addresses;
-
-        for (unsigned int j = 0 ; j < block->subnet_len ; j++) {
-          if (lease_iter->state == OFFERED && lease_iter->xid == request->xid) {
-            if (memcmp(request->chaddr, lease_iter->chaddr, 16) == 0) {
-              lease = lease_iter;
-              lease_block = block;
-              lease_index = j;
-              DEBUG("dhcp_request(...): Found requested lease\n");
-              break;
-            }
-          }
-
-          lease_iter++;
-        }
-
-        if (lease) {
-          break;
-        }
+    while ((lease_iter = lease_index_find(&config->lease_requests, (uint8_t*) request->chaddr, request->xid, &cursor)) != NULL) {
+      if (lease_iter->state == OFFERED && block_state(lease_iter->block) == DDHCP_OURS) {
+        lease = lease_iter;
+        lease_block = lease_iter->block;
+        lease_index = lease_iter - lease_block->addresses;
+        DEBUG("dhcp_request(...): Found requested lease\n");
+        break;
       }
-
-      block++;
     }
   }
 
   if (!lease) {
     DEBUG("dhcp_request(...): Requested lease not found\n");
     // Send DHCP_NACK
-    dhcp_nack(socket, request);
+    dhcp_nack(socket, request, config);
     return 2;
   }
 
-  return dhcp_ack(socket, request, lease_block, lease_index, config);
+  if (dhcp_ack(socket, request, lease_block, lease_index, config)) {
+    return 1;
+  }
+
+  txqueue_stamp(&config->tx_queue, LATENCY_ACK_LOCAL, &request->received);
+  return 0;
 }
 
-void dhcp_hdl_release(dhcp_packet* packet, ddhcp_block* blocks, ddhcp_config* config) {
+void dhcp_hdl_release(dhcp_packet* packet, block_table* blocks, ddhcp_config* config) {
   DEBUG("dhcp_hdl_release(dhcp_packet, blocks, config)\n");
   ddhcp_block* lease_block = NULL;
   uint32_t lease_index = 0;
@@ -381,7 +448,7 @@ void dhcp_hdl_release(dhcp_packet* packet, ddhcp_block* blocks, ddhcp_config* co
 
     // Check Hardware Address of client
     if (memcmp(packet->chaddr, lease->chaddr, 16) == 0) {
-      _dhcp_release_lease(lease_block, lease_index);
+      _dhcp_release_lease(lease_block, lease_index, config);
     } else {
       ERROR("Hardware Adress transmitted by client and our record did not match, do nothing.\n");
     }
@@ -397,103 +464,66 @@ void dhcp_hdl_release(dhcp_packet* packet, ddhcp_block* blocks, ddhcp_config* co
   }
 }
 
-int dhcp_nack(int socket, dhcp_packet* from_client) {
-  dhcp_packet* packet = build_initial_packet(from_client);
+int dhcp_nack(int socket, dhcp_packet* from_client, ddhcp_config* config) {
+  dhcp_reply reply;
+  dhcp_reply_init(&reply, txqueue_buffer(&config->tx_queue), TXQUEUE_BUFFER_SIZE, from_client);
 
-  if (! packet) {
-    DEBUG("dhcp_discover(...) -> memory allocation failure\n");
-    return 1;
-  }
-
-  packet->options_len = 1;
-  packet->options = (dhcp_option*) calloc(sizeof(dhcp_option), 1);
-  // TODO Error handling
-
-  set_option(packet->options, packet->options_len, DHCP_CODE_MESSAGE_TYPE, 1, (uint8_t[]) {
+  dhcp_reply_option(&reply, DHCP_CODE_MESSAGE_TYPE, 1, (uint8_t[]) {
     DHCPNAK
   });
+  stats_dhcp_sent(DHCPNAK);
 
-  dhcp_packet_send(socket, packet);
-  free(packet);
+  dhcp_reply_send(socket, &reply, &config->tx_queue);
 
   return 0;
 }
 
 int dhcp_ack(int socket, dhcp_packet* request, ddhcp_block* lease_block, uint32_t lease_index, ddhcp_config* config) {
-  time_t now = time(NULL);
-  dhcp_packet* packet = build_initial_packet(request);
-  dhcp_lease* lease = lease_block->addresses + lease_index;
-
-  if (! packet) {
-    DEBUG("dhcp_request(...) -> memory allocation failure\n");
-    return 1;
-  }
+  time_t now = clock_now();
 
   // Mark lease as leased and register client
-  memcpy(&lease->chaddr, &request->chaddr, 16);
-  lease->xid = request->xid;
-  lease->state = LEASED;
-  lease->lease_end = now + DHCP_LEASE_TIME + DHCP_LEASE_SERVER_DELTA;
+  _dhcp_lease_assign(lease_block, lease_index, LEASED, request->chaddr, request->xid, now + DHCP_LEASE_TIME + DHCP_LEASE_SERVER_DELTA, config);
 
-  addr_add(&lease_block->subnet, &packet->yiaddr, lease_index);
-  DEBUG("dhcp_ack(...) offering address %i %s\n", lease_index, inet_ntoa(packet->yiaddr));
+  dhcp_reply reply;
+  struct in_addr yiaddr;
+  dhcp_reply_init(&reply, txqueue_buffer(&config->tx_queue), TXQUEUE_BUFFER_SIZE, request);
 
-  // TODO We need a more extendable way to build up options
-  packet->options_len = fill_options(request->options, request->options_len, &(config->options), 2, &packet->options) ;
+  addr_add(&lease_block->subnet, &yiaddr, lease_index);
+  dhcp_reply_yiaddr(&reply, &yiaddr);
+  DEBUG("dhcp_ack(...) offering address %i %s\n", lease_index, inet_ntoa(yiaddr));
 
-  // TODO Error handling
-  set_option(packet->options, packet->options_len, DHCP_CODE_MESSAGE_TYPE, 1, (uint8_t[]) {
+  dhcp_reply_option(&reply, DHCP_CODE_MESSAGE_TYPE, 1, (uint8_t[]) {
     DHCPACK
   });
+  stats_dhcp_sent(DHCPACK);
   // TODO correct type conversion, currently solution is simply wrong
-  set_option(packet->options, packet->options_len, DHCP_CODE_ADDRESS_LEASE_TIME, 4, (uint8_t[]) {
+  dhcp_reply_option(&reply, DHCP_CODE_ADDRESS_LEASE_TIME, 4, (uint8_t[]) {
     0, 0, 0, DHCP_LEASE_TIME
   });
 
-  dhcp_packet_send(socket, packet);
-  free(packet->options);
-  free(packet);
-  return 0;
-}
-
-int dhcp_has_free(struct ddhcp_block* block) {
-  dhcp_lease* lease = block->addresses;
-
-  for (unsigned int i = 0; i < block->subnet_len; i++) {
-    if (lease->state == FREE) {
-      return 1;
-    }
+  dhcp_option_blob* blob = fill_options(request, &config->options);
 
-    lease++;
+  if (blob) {
+    dhcp_reply_options(&reply, blob->data, blob->len);
   }
 
+  dhcp_reply_send(socket, &reply, &config->tx_queue);
   return 0;
 }
 
-int dhcp_num_free(struct ddhcp_block* block) {
-  int num = 0;
-  dhcp_lease* lease = block->addresses;
-
-  for (unsigned int i = 0 ; i < block->subnet_len ; i++) {
-    if (lease->state == FREE) {
-      num++;
-    }
-
-    lease++;
-  }
+int dhcp_has_free(struct ddhcp_block* block) {
+  return block->leases_free > 0;
+}
 
-  return num;
+int dhcp_num_free(struct ddhcp_block* block) {
+  return block->leases_free;
 }
 
 uint32_t dhcp_get_free_lease(ddhcp_block* block) {
-  dhcp_lease* lease = block->addresses;
-
-  for (uint32_t i = 0 ; i < block->subnet_len ; i++) {
-    if (lease->state == FREE) {
-      return i;
+  for (uint32_t i = 0 ; i < LEASE_MAP_WORDS(block->subnet_len) ; i++) {
+    if (block->lease_map[i]) {
+      return i * 64 + __builtin_ctzll(block->lease_map[i]);
     }
-
-    lease++;
   }
 
   ERROR("dhcp_get_free_lease(...): no free lease found");
@@ -501,7 +531,7 @@ uint32_t dhcp_get_free_lease(ddhcp_block* block) {
   return block->subnet_len;
 }
 
-void dhcp_release_lease(uint32_t address, ddhcp_block* blocks, ddhcp_config* config) {
+void dhcp_release_lease(uint32_t address, block_table* blocks, ddhcp_config* config) {
 
   ddhcp_block* lease_block = NULL;
   uint32_t lease_index = 0;
@@ -510,30 +540,48 @@ void dhcp_release_lease(uint32_t address, ddhcp_block* blocks, ddhcp_config* con
   uint8_t found = find_lease_from_address(&addr, blocks, config, &lease_block, &lease_index);
 
   if (found == 0) {
-    _dhcp_release_lease(lease_block, lease_index);
+    _dhcp_release_lease(lease_block, lease_index, config);
   } else {
     DEBUG("No lease for Address %s found.\n", inet_ntoa(addr));
   }
 }
 
-int dhcp_check_timeouts(ddhcp_block* block) {
-  DEBUG("dhcp_check_timeouts(block)\n");
-  dhcp_lease* lease = block->addresses;
-  time_t now = time(NULL);
-
-  int free_leases = 0;
+dhcp_lease* dhcp_find_client_lease(uint8_t* chaddr, ddhcp_config* config) {
+  dhcp_lease* lease;
+  uint32_t cursor = LEASE_INDEX_START;
 
-  for (unsigned int i = 0 ; i < block->subnet_len ; i++) {
-    if (lease->state != FREE && lease->lease_end < now) {
-      _dhcp_release_lease(block, i);
+  while ((lease = lease_index_find(&config->lease_clients, chaddr, 0, &cursor)) != NULL) {
+    if (block_state(lease->block) == DDHCP_OURS) {
+      return lease;
     }
+  }
 
-    if (lease->state == FREE) {
-      free_leases++;
-    }
+  return NULL;
+}
 
-    lease++;
+void dhcp_forget_leases(ddhcp_block* block, ddhcp_config* config) {
+  for (unsigned int index = 0; index < block->subnet_len; index++) {
+    dhcp_lease* lease = block->addresses + index;
+
+    _dhcp_lease_unindex(lease, config);
+    timer_cancel(&config->lease_timeouts, &lease->expiry_node);
   }
+}
+
+void dhcp_check_timeouts(ddhcp_config* config) {
+  DEBUG("dhcp_check_timeouts(config)\n");
+  time_t now = clock_now();
+  timer_node* node;
+
+  while ((node = timer_pop_expired(&config->lease_timeouts, now)) != NULL) {
+    dhcp_lease* lease = container_of(node, dhcp_lease, expiry_node);
+    ddhcp_block* block = lease->block;
 
-  return free_leases;
+    _dhcp_release_lease(block, lease - block->addresses, config);
+
+    // Drop lease arrays of foreign blocks once their last lease is gone.
+    if (block_state(block) != DDHCP_OURS && block->leases_free == block->subnet_len) {
+      block_free(block, config);
+    }
+  }
 }
@@ -5,39 +5,40 @@
  */
 
 #include "types.h"
+#include "block_table.h"
 #include "dhcp_packet.h"
 
 /**
  * DHCP Discover
  * Performs a search for a available, not already offered address in the
- * available block. When the block has no further available addresses 0 is returned,
+ * blocks we own. When the block has no further available addresses 0 is returned,
  * otherwise the then reserved address. Will set a lease_timout on the lease.
  *
  * In a second step a dhcp_packet is created an send back.
  */
-int dhcp_hdl_discover(int socket, dhcp_packet* discover, ddhcp_block* blocks, ddhcp_config* config);
+int dhcp_hdl_discover(int socket, dhcp_packet* discover, ddhcp_config* config);
 
 /**
  * DHCP Request
  * Performs on base of de
  */
-int dhcp_hdl_request(int socket, struct dhcp_packet* request, ddhcp_block* blocks, ddhcp_config* config);
+int dhcp_hdl_request(int socket, struct dhcp_packet* request, block_table* blocks, ddhcp_config* config);
 
 /**
  * DDHCP Remote Request (Renew)
  */
-int dhcp_rhdl_request(uint32_t* address, ddhcp_block* blocks, ddhcp_config* config);
+int dhcp_rhdl_request(uint32_t* address, block_table* blocks, ddhcp_config* config);
 /**
  * DDHCP Remote Answer (Ack)
  */
-int dhcp_rhdl_ack(int socket, struct dhcp_packet* request, ddhcp_block* blocks, ddhcp_config* config);
+int dhcp_rhdl_ack(int socket, struct dhcp_packet* request, block_table* blocks, ddhcp_config* config);
 
 /**
  * DHCP Release
  */
-void dhcp_hdl_release(dhcp_packet* packet, ddhcp_block* block, ddhcp_config* config);
+void dhcp_hdl_release(dhcp_packet* packet, block_table* blocks, ddhcp_config* config);
 
-int dhcp_nack(int socket, dhcp_packet* from_client);
+int dhcp_nack(int socket, dhcp_packet* from_client, ddhcp_config* config);
 int dhcp_ack(int socket, dhcp_packet* request, ddhcp_block* lease_block, uint32_t lease_index, ddhcp_config* config);
 
 /**
@@ -48,12 +49,13 @@ int dhcp_has_free(struct ddhcp_block* block);
 
 /**
  * DHCP num Leases Available
- * Enumerate the free leases in a block
+ * Number of free leases in a block, taken from the lease counters of the block.
  */
 int dhcp_num_free(struct ddhcp_block* block);
 
 /**
- * Find first free lease in lease block and return its index.
+ * Find first free lease in lease block and return its index, searched
+ * word wise in the lease map of the block.
  * This function asserts that there is a free lease, otherwise
  * it returns the value of block_subnet_len.
  */
@@ -65,12 +67,27 @@ uint32_t dhcp_get_free_lease(ddhcp_block* block);
  * since there is no reply to a dhcp release packet
  * no further internal handling is needed.
  */
-void dhcp_release_lease(uint32_t address, ddhcp_block* blocks, ddhcp_config* config);
+void dhcp_release_lease(uint32_t address, block_table* blocks, ddhcp_config* config);
 
 /**
- * HouseKeeping: Check for timed out leases.
- * Return the number of free leases in the block.
+ * Find a lease of a client in one of our blocks by its hardware address,
+ * looked up in the client index of the configuration. Returns NULL iff
+ * the client holds no such lease.
  */
-int dhcp_check_timeouts(ddhcp_block* block);
+dhcp_lease* dhcp_find_client_lease(uint8_t* chaddr, ddhcp_config* config);
+
+/**
+ * Unregister all leases of a block from the lease indices and timeouts,
+ * before its lease array is released.
+ */
+void dhcp_forget_leases(ddhcp_block* block, ddhcp_config* config);
+
+/**
+ * HouseKeeping: Free timed out leases.
+ * Only the expired leases are visited, they are taken from the lease
+ * timeouts of the configuration. Lease arrays of blocks we do not own
+ * are released, when their last lease times out.
+ */
+void dhcp_check_timeouts(ddhcp_config* config);
 
 #endif
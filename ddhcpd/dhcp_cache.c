@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "dhcp_cache.h"
+#include "clock.h"
+#include "logger.h"
+#include "stats.h"
+#include "tools.h"
+
+static uint32_t _dhcp_cache_bucket(dhcp_cache* cache, uint32_t xid, uint8_t* chaddr) {
+  uint8_t xid_bytes[4] = { xid, xid >> 8, xid >> 16, xid >> 24 };
+  uint32_t hash = fnv1a(fnv1a(FNV1A_INIT, xid_bytes, 4), chaddr, 16);
+
+  return hash & cache->bucket_mask;
+}
+
+static dhcp_cache_entry** _dhcp_cache_lookup(dhcp_cache* cache, uint32_t xid, uint8_t* chaddr) {
+  dhcp_cache_entry** link = cache->buckets + _dhcp_cache_bucket(cache, xid, chaddr);
+
+  while (*link) {
+    if ((*link)->xid == xid && memcmp((*link)->chaddr, chaddr, 16) == 0) {
+      break;
+    }
+
+    link = &(*link)->hash_next;
+  }
+
+  return link;
+}
+
+static void _dhcp_cache_drop(dhcp_cache* cache, dhcp_cache_entry* entry) {
+  dhcp_cache_entry** link = _dhcp_cache_lookup(cache, entry->xid, entry->chaddr);
+  *link = entry->hash_next;
+
+  timer_cancel(&cache->expiry, &entry->expiry_node);
+  list_move(&entry->lru_list, &cache->free);
+
+  slab_release(&cache->arena, entry->wire);
+  entry->wire = NULL;
+  cache->count--;
+}
+
+int dhcp_cache_init(dhcp_cache* cache, uint32_t capacity) {
+  DEBUG("dhcp_cache_init(cache, %u)\n", capacity);
+  uint32_t num_buckets = 1;
+
+  while (num_buckets < capacity) {
+    num_buckets <<= 1;
+  }
+
+  cache->entries = (dhcp_cache_entry*) calloc(sizeof(dhcp_cache_entry), capacity);
+  cache->buckets = (dhcp_cache_entry**) calloc(sizeof(dhcp_cache_entry*), num_buckets);
+
+  if (!cache->entries || !cache->buckets) {
+    ERROR("dhcp_cache_init(...) -> Unable to allocate memory\n");
+    free(cache->entries);
+    free(cache->buckets);
+    return 1;
+  }
+
+  if (slab_init(&cache->arena, DHCP_CACHE_SLOT_SIZE, DHCP_CACHE_SLOTS_PER_CHUNK)) {
+    free(cache->entries);
+    free(cache->buckets);
+    return 1;
+  }
+
+  cache->capacity = capacity;
+  cache->count = 0;
+  cache->bucket_mask = num_buckets - 1;
+  INIT_LIST_HEAD(&cache->lru);
+  INIT_LIST_HEAD(&cache->free);
+  timer_heap_init(&cache->expiry);
+
+  for (uint32_t i = 0; i < capacity; i++) {
+    list_add_tail(&cache->entries[i].lru_list, &cache->free);
+  }
+
+  return 0;
+}
+
+void dhcp_cache_free(dhcp_cache* cache) {
+  DEBUG("dhcp_cache_free(cache)\n");
+
+  while (!list_empty(&cache->lru)) {
+    _dhcp_cache_drop(cache, list_first_entry(&cache->lru, dhcp_cache_entry, lru_list));
+  }
+
+  timer_heap_free(&cache->expiry);
+  slab_free(&cache->arena);
+  free(cache->entries);
+  free(cache->buckets);
+  cache->entries = NULL;
+  cache->buckets = NULL;
+  cache->capacity = 0;
+}
+
+int dhcp_cache_add(dhcp_cache* cache, dhcp_packet* packet) {
+  time_t now = clock_now();
+
+  if (!packet->raw || packet->raw_len > DHCP_CACHE_SLOT_SIZE) {
+    ERROR("dhcp_cache_add( ... ) -> Packet can't be cached\n");
+    return 1;
+  }
+
+  dhcp_cache_entry** link = _dhcp_cache_lookup(cache, packet->xid, (uint8_t*) packet->chaddr);
+
+  if (*link) {
+    DEBUG("dhcp_cache_add( ... ): Replace packet (%u)\n", packet->xid);
+    _dhcp_cache_drop(cache, *link);
+  } else if (list_empty(&cache->free)) {
+    DEBUG("dhcp_cache_add( ... ): Cache full, evict least recently used packet\n");
+    _dhcp_cache_drop(cache, list_last_entry(&cache->lru, dhcp_cache_entry, lru_list));
+  }
+
+  dhcp_cache_entry* entry = list_first_entry(&cache->free, dhcp_cache_entry, lru_list);
+  entry->wire = (uint8_t*) slab_alloc(&cache->arena);
+
+  if (!entry->wire) {
+    ERROR("dhcp_cache_add( ... ) -> Unable to allocate memory\n");
+    return 1;
+  }
+
+  if (timer_schedule(&cache->expiry, &entry->expiry_node, now + DHCP_CACHE_TIMEOUT)) {
+    slab_release(&cache->arena, entry->wire);
+    entry->wire = NULL;
+    return 1;
+  }
+
+  memcpy(entry->wire, packet->raw, packet->raw_len);
+  entry->len = packet->raw_len;
+  entry->received = packet->received;
+  entry->xid = packet->xid;
+  memcpy(entry->chaddr, packet->chaddr, 16);
+
+  // The lookup above may be stale after a drop.
+  link = _dhcp_cache_lookup(cache, entry->xid, entry->chaddr);
+  entry->hash_next = NULL;
+  *link = entry;
+  list_move(&entry->lru_list, &cache->lru);
+  cache->count++;
+
+  return 0;
+}
+
+int dhcp_cache_find(dhcp_cache* cache, uint32_t xid, uint8_t* chaddr, dhcp_packet* packet) {
+  DEBUG("dhcp_cache_find(cache,xid:%u,chaddr)\n", xid);
+  dhcp_cache_entry* entry = *_dhcp_cache_lookup(cache, xid, chaddr);
+
+  if (!entry) {
+    DEBUG("dhcp_cache_find( ... ) -> No matching packet found\n");
+    stats.cache_misses++;
+    return 1;
+  }
+
+  if (entry->expiry_node.deadline < clock_now()) {
+    DEBUG("dhcp_cache_find( ... ): Removing packet from cache\n");
+    stats.cache_misses++;
+    _dhcp_cache_drop(cache, entry);
+    return 1;
+  }
+
+  // The datagram has been checked, when it was read.
+  if (ntoh_dhcp_packet(packet, entry->wire, entry->len) != 0) {
+    ERROR("dhcp_cache_find( ... ) -> Unable to parse cached packet\n");
+    _dhcp_cache_drop(cache, entry);
+    return 1;
+  }
+
+  packet->received = entry->received;
+
+  DEBUG("dhcp_cache_find( ... ) -> packet found\n");
+  stats.cache_hits++;
+  list_move(&entry->lru_list, &cache->lru);
+
+  return 0;
+}
+
+void dhcp_cache_timeout(dhcp_cache* cache) {
+  DEBUG("dhcp_cache_timeout(cache)\n");
+  time_t now = clock_now();
+  timer_node* node;
+
+  while ((node = timer_peek(&cache->expiry)) != NULL && node->deadline < now) {
+    DEBUG("dhcp_cache_timeout( ... ): drop packet from cache\n");
+    _dhcp_cache_drop(cache, container_of(node, dhcp_cache_entry, expiry_node));
+  }
+}
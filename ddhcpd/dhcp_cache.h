@@ -0,0 +1,92 @@
+#ifndef _DHCP_CACHE_H
+#define _DHCP_CACHE_H
+
+#include <stdint.h>
+
+#include "dhcp_packet.h"
+#include "list.h"
+#include "slab.h"
+#include "timer.h"
+
+// Number of DHCP requests kept while waiting for a remote lease ack.
+#define DHCP_CACHE_CAPACITY 1024
+
+// Seconds a cached request stays valid.
+#define DHCP_CACHE_TIMEOUT 120
+
+// Size of an arena slot, large enough for every datagram we read.
+#define DHCP_CACHE_SLOT_SIZE 1500
+
+// Number of slots the arena grows by.
+#define DHCP_CACHE_SLOTS_PER_CHUNK 64
+
+struct dhcp_cache_entry {
+  // Header view of the cached datagram.
+  uint32_t xid;
+  uint8_t chaddr[16];
+  uint16_t len;
+  // Kernel receive timestamp of the datagram.
+  struct timespec received;
+  // Arena slot holding the datagram, as received from the client.
+  uint8_t* wire;
+  // Next entry in the same hash bucket.
+  struct dhcp_cache_entry* hash_next;
+  // Entry in the lru list of used entries or in the free list.
+  struct list_head lru_list;
+  timer_node expiry_node;
+};
+typedef struct dhcp_cache_entry dhcp_cache_entry;
+
+/**
+ * A bounded cache of DHCP requests keyed by xid and chaddr. The entries
+ * are allocated up front, when the cache is full the least recently used
+ * entry is evicted. Expired entries are dropped via a timer heap.
+ * Requests are kept as the datagrams they were read from, each one in
+ * a slot of the arena, and parsed again when they are looked up.
+ */
+struct dhcp_cache {
+  dhcp_cache_entry* entries;
+  slab arena;
+  uint32_t capacity;
+  uint32_t count;
+  dhcp_cache_entry** buckets;
+  // Number of buckets minus one, the number of buckets is a power of two.
+  uint32_t bucket_mask;
+  // Most recently used entries first.
+  struct list_head lru;
+  struct list_head free;
+  timer_heap expiry;
+};
+typedef struct dhcp_cache dhcp_cache;
+
+/**
+ * Prepare an empty cache for up to capacity packets.
+ * Returns a value greater 0 on failure.
+ */
+int dhcp_cache_init(dhcp_cache* cache, uint32_t capacity);
+
+/**
+ * Release all packets and the memory of the cache.
+ */
+void dhcp_cache_free(dhcp_cache* cache);
+
+/**
+ * Store the datagram packet was read from in the cache, an older packet
+ * with the same xid and chaddr is replaced. Returns a value greater 0 on failure.
+ */
+int dhcp_cache_add(dhcp_cache* cache, dhcp_packet* packet);
+
+/**
+ * Search for a packet checking xid and chaddr and parse it into packet,
+ * along with its receive timestamp.
+ * The packet points into the cache, it is valid until the cache is modified.
+ * Returns a value greater 0 iff no packet is found or the packet is expired.
+ */
+int dhcp_cache_find(dhcp_cache* cache, uint32_t xid, uint8_t* chaddr, dhcp_packet* packet);
+
+/**
+ * Drop expired packets from the cache.
+ */
+void dhcp_cache_timeout(dhcp_cache* cache);
+
+#endif
@@ -6,87 +6,49 @@
 #include "logger.h"
 #include "tools.h"
 
-dhcp_option* find_option(dhcp_option* options, uint8_t len, uint8_t code) {
-  dhcp_option* option = options;
-
-  for (; option < options + len; option++) {
-    if (option->code == code) {
-      return option;
-    }
-  }
-
-  return NULL;
-}
-
-int set_option(dhcp_option* options, uint8_t len, uint8_t code, uint8_t payload_len, uint8_t* payload) {
-  DEBUG("set_option( options, len:%i, code:%i, payload_len:%i, payload)\n", len, code, payload_len);
-
-  for (int i = len - 1; i >= 0; i--) {
-    DEBUG("set_option(...) %i\n", i);
-    dhcp_option* option = options + i;
-
-    if (option->code == code || option->code == 0) {
-      option->code = code;
-      option->len = payload_len;
-      option->payload = payload;
-
-      DEBUG("set_option(...) -> set option at %i \n", i);
-
-      return 0;
-    }
-  }
-
-  DEBUG("set_option(...) -> failed\n");
-  return 1;
-}
-
-int find_option_parameter_request_list(dhcp_option* options, uint8_t len, uint8_t** requested) {
-  dhcp_option* option = find_option(options, len, DHCP_CODE_PARAMETER_REQUEST_LIST);
+int find_option_parameter_request_list(dhcp_packet* packet, uint8_t** requested) {
+  uint8_t len = 0;
+  uint8_t* payload = dhcp_packet_option(packet, DHCP_CODE_PARAMETER_REQUEST_LIST, &len);
 
   if (requested) {
-    *requested = option ? (uint8_t*) option->payload : NULL;
+    *requested = payload;
   }
 
-  int optlen = option ? option->len : 0;
+  int optlen = payload ? len : 0;
 
   DEBUG("find_option_parameter_request_list(...) -> %i\n", optlen);
 
   return optlen;
 }
 
-uint8_t* find_option_requested_address(dhcp_option* options, uint8_t len) {
-  dhcp_option* option = find_option(options, len, DHCP_CODE_REQUESTED_ADDRESS);
+uint8_t* find_option_requested_address(dhcp_packet* packet) {
+  uint8_t len = 0;
+  uint8_t* payload = dhcp_packet_option(packet, DHCP_CODE_REQUESTED_ADDRESS, &len);
+
+  if (payload && len != 4) {
+    payload = NULL;
+  }
 
-  DEBUG("find_option_requested_address(...) -> address %s\n", option ? "found" : "not found");
+  DEBUG("find_option_requested_address(...) -> address %s\n", payload ? "found" : "not found");
 
-  return option ? option->payload : NULL;
+  return payload;
 }
 
-dhcp_option* find_in_option_store(dhcp_option_list* options, uint8_t code) {
+dhcp_option* find_in_option_store(dhcp_option_store* options, uint8_t code) {
   DEBUG("find_in_option_store( store, code: %i)\n", code);
 
-  dhcp_option* option = NULL;
-  struct list_head* pos, *q;
-  dhcp_option_list* tmp;
-
-  list_for_each_safe(pos, q, &options->list) {
-    tmp = list_entry(pos, dhcp_option_list, list);
-    option = tmp->option;
-
-    if (option->code == code) {
-      DEBUG("find_in_option_store(...) -> %i\n", code);
-      return option;
-    }
-  }
-
-  return NULL;
+  return options->table[code];
 }
 
-dhcp_option* set_option_in_store(dhcp_option_list* store, dhcp_option* option) {
+dhcp_option* set_option_in_store(dhcp_option_store* store, dhcp_option* option) {
   DEBUG("set_in_option_store( store, code/len: %i/%i)\n", option->code, option->len);
 
   dhcp_option* current = find_in_option_store(store, option->code);
 
+  // Encoded options may contain the previous payload.
+  store->num_blobs = 0;
+  store->next_blob = 0;
+
   if (current != NULL) {
     DEBUG("set_in_option_store(...) -> replace option\n");
 
@@ -108,12 +70,13 @@ dhcp_option* set_option_in_store(dhcp_option_list* store, dhcp_option* option) {
     tmp->option = option;
 
     list_add_tail((&tmp->list), &(store->list));
+    store->table[option->code] = option;
 
     return option;
   }
 }
 
-void free_option_store(dhcp_option_list* store) {
+void free_option_store(dhcp_option_store* store) {
   struct list_head* pos, *q;
   dhcp_option_list* tmp;
 
@@ -126,41 +89,83 @@ void free_option_store(dhcp_option_list* store) {
       free(option->payload);
     }
 
+    store->table[option->code] = NULL;
     free(option);
     free(tmp);
   }
+
+  store->num_blobs = 0;
+  store->next_blob = 0;
 }
 
-dhcp_option* remove_option_from_store(dhcp_option_list* store, uint8_t code);
+dhcp_option* remove_option_from_store(dhcp_option_store* store, uint8_t code);
 
-int fill_options(dhcp_option* options, uint8_t len, dhcp_option_list* option_store, uint8_t additional, dhcp_option** fullfil) {
-  int num_found_options = 0;
+static uint32_t _option_blob_hash(uint8_t* requested, uint8_t len) {
+  return fnv1a(FNV1A_INIT, requested, len);
+}
+
+static void _option_blob_compile(dhcp_option_blob* blob, dhcp_option_store* store) {
+  blob->len = 0;
+
+  for (int i = 0; i < blob->prl_len; i++) {
+    uint8_t code = blob->prl[i];
+    dhcp_option* option = store->table[code];
+
+    // The message type and lease time differ per reply.
+    if (!option || code == DHCP_CODE_PAD || code == DHCP_CODE_END
+        || code == DHCP_CODE_MESSAGE_TYPE || code == DHCP_CODE_ADDRESS_LEASE_TIME) {
+      continue;
+    }
 
+    if (blob->len + 2 + option->len > DHCP_OPTION_BLOB_SIZE) {
+      WARNING("fill_options(...) -> requested options exceed %i bytes\n", DHCP_OPTION_BLOB_SIZE);
+      break;
+    }
+
+    blob->data[blob->len] = code;
+    blob->data[blob->len + 1] = option->len;
+    memcpy(blob->data + blob->len + 2, option->payload, option->len);
+    blob->len += 2 + option->len;
+  }
+}
+
+dhcp_option_blob* fill_options(dhcp_packet* packet, dhcp_option_store* option_store) {
   uint8_t* requested = NULL;
-  int8_t max_options = find_option_parameter_request_list(options, len, &requested);
+  uint8_t len = find_option_parameter_request_list(packet, &requested);
 
-  if (! max_options) {
-    *fullfil = NULL;
-    return 0;
+  if (! requested) {
+    return NULL;
   }
 
-  *fullfil = (dhcp_option*) calloc(sizeof(dhcp_option), max_options + additional);
+  uint32_t hash = _option_blob_hash(requested, len);
 
-  for (uint8_t i = additional; i < max_options; i++) {
-    uint8_t code = requested[i];
-    // LOOP thought option_store
-    dhcp_option* option = find_in_option_store(option_store, code);
+  for (int i = 0; i < option_store->num_blobs; i++) {
+    dhcp_option_blob* blob = option_store->blobs + i;
 
-    if (option != NULL) {
-      memcpy(*fullfil + num_found_options, option, sizeof(dhcp_option));
-      num_found_options++;
+    if (blob->hash == hash && blob->prl_len == len && memcmp(blob->prl, requested, len) == 0) {
+      return blob;
     }
   }
 
-  return num_found_options + additional;
+  DEBUG("fill_options(...) -> compile options for new parameter request list\n");
+
+  // Replace cached lists round robin.
+  dhcp_option_blob* blob = option_store->blobs + option_store->next_blob;
+  option_store->next_blob = (option_store->next_blob + 1) % DHCP_OPTION_BLOBS;
+
+  if (option_store->num_blobs < DHCP_OPTION_BLOBS) {
+    option_store->num_blobs++;
+  }
+
+  blob->hash = hash;
+  blob->prl_len = len;
+  memcpy(blob->prl, requested, len);
+  _option_blob_compile(blob, option_store);
+
+  return blob;
 }
 
-void dhcp_options_show(int fd, dhcp_option_list* store) {
+void dhcp_options_show(int fd, dhcp_option_store* store) {
   struct list_head* pos, *q;
   dhcp_option_list* tmp;
 
@@ -24,7 +24,7 @@ void printf_dhcp(dhcp_packet* packet) {
   char* siaddr_str = (char*) malloc(INET_ADDRSTRLEN);
   inet_ntop(AF_INET, &(packet->siaddr.s_addr), siaddr_str, INET_ADDRSTRLEN);
 
-  printf(" BOOTP [ op %i, htype %i, hlen %i, hops %i, xid %lu, secs %i, flags %i, ciaddr %s, yiaddr %s, siaddr %s, giaddr %s, sname: %s, file: %s ]\n"
+  INFO(" BOOTP [ op %i, htype %i, hlen %i, hops %i, xid %lu, secs %i, flags %i, ciaddr %s, yiaddr %s, siaddr %s, giaddr %s, sname: %s, file: %s ]\n"
          , packet->op
          , packet->htype
          , packet->hlen
@@ -45,47 +45,31 @@ void printf_dhcp(dhcp_packet* packet) {
   free(giaddr_str);
   free(siaddr_str);
 
-  dhcp_option* option = packet->options;
+  for (int code = 0; code < 256; code++) {
+    uint8_t len;
+    uint8_t* payload = dhcp_packet_option(packet, code, &len);
 
-  for (int i = 0; i < packet->options_len; i++) {
-    if (option->len == 1) {
-      printf("DHCP OPTION [ code %i, length %i, value %i ]\n", option->code, option->len, option->payload[0]);
-    } else if (option->code == DHCP_CODE_PARAMETER_REQUEST_LIST) {
-      printf("DHCP OPTION [ code %i, length %i, value ", option->code, option->len);
-
-      for (int k = 0; k < option->len; k++) {
-        printf("%i ", option->payload[k]);
-      }
-
-      printf("]\n");
-    } else {
-      printf("DHCP OPTION [ code %i, length %i ]\n", option->code, option->len);
+    if (!payload) {
+      continue;
     }
 
-    option++;
-  }
-}
-
-int _dhcp_packet_len(dhcp_packet* packet) {
-  int len = 240 + 1;
-  dhcp_option* option = packet->options;
+    if (len == 1) {
+      INFO("DHCP OPTION [ code %i, length %i, value %i ]\n", code, len, payload[0]);
+    } else if (code == DHCP_CODE_PARAMETER_REQUEST_LIST) {
+      // Up to 255 values of at most 4 chars each.
+      char values[1024];
+      int pos = 0;
 
-  for (int i = 0; i < packet->options_len; i++) {
-    switch (option->code) {
-    case DHCP_CODE_PAD:
-    case DHCP_CODE_END:
-      len++;
-      break;
+      for (int k = 0; k < len; k++) {
+        pos += snprintf(values + pos, sizeof(values) - pos, "%i ", payload[k]);
+      }
 
-    default:
-      len += 2 + option->len;
-      break;
+      values[pos] = 0;
+      INFO("DHCP OPTION [ code %i, length %i, value %s]\n", code, len, values);
+    } else {
+      INFO("DHCP OPTION [ code %i, length %i ]\n", code, len);
     }
-
-    option++;
   }
-
-  return len;
 }
 
 int ntoh_dhcp_packet(dhcp_packet* packet, uint8_t* buffer, int len) {
@@ -97,7 +81,12 @@ int ntoh_dhcp_packet(dhcp_packet* packet, uint8_t* buffer, int len) {
     return -1;
   }
 
-  printf("LEN:%i\n", len);
+  DEBUG("ntoh_dhcp_packet(packet, buffer, %i)\n", len);
+
+  packet->raw = buffer;
+  packet->raw_len = len;
+  packet->received.tv_sec = 0;
+  packet->received.tv_nsec = 0;
 
   // TODO Use macros to read from the buffer
 
@@ -125,292 +114,159 @@ int ntoh_dhcp_packet(dhcp_packet* packet, uint8_t* buffer, int len) {
         && (uint8_t) buffer[238] == 83
         && (uint8_t) buffer[239] == 99
        )) {
-    printf("Warning: Magic cookie not found!\n");
+    WARNING("ntoh_dhcp_packet(...) -> Magic cookie not found\n");
     return -7;
   }
 
+  memset(packet->option_offsets, 0, sizeof(packet->option_offsets));
+
   uint8_t* option = buffer + 236 + 4;
 
-  // Count options
-  int options = 0;
-  int exit = 0;
-  int dhcp_message_type = 0;
-  int dhcp_request_list = 0;
+  while (option < buffer + len) {
+    uint8_t code = option[0];
 
-  while (option < buffer + len && exit == 0) {
-    switch ((uint8_t) option[0]) {
-    case DHCP_CODE_PAD:
+    if (code == DHCP_CODE_PAD) {
       // JUMP the padding
       option += 1;
       continue;
-      break;
-
-    case DHCP_CODE_END:
-      option += 1;
-      exit = 1;
-      //continue;
-      break;
-
-    case DHCP_CODE_MESSAGE_TYPE:
-      dhcp_message_type = 1;
-      break;
-
-    case DHCP_CODE_PARAMETER_REQUEST_LIST:
-      dhcp_request_list = 1;
-      break;
+    }
 
-    default:
+    if (code == DHCP_CODE_END) {
       break;
     }
 
-    if (option + 1 > buffer + len) {
-      printf("Warning: DHCP options ended improperly, possible broken client.\n");
+    if (option + 2 > buffer + len) {
+      WARNING("ntoh_dhcp_packet(...) -> DHCP options ended improperly, possible broken client\n");
       return -4;
     }
 
     if (option + option[1] + 2 > buffer + len) {
       // Error: Malformed dhcp options
-      printf("Warning: DHCP options smaller than len of last option suggest, possible broken client.\n");
+      WARNING("ntoh_dhcp_packet(...) -> DHCP options smaller than len of last option suggest, possible broken client\n");
       return -5;
-    } else {
-      option += (uint8_t) option[1] + 2;
-      options++;
     }
+
+    // Only the first occurrence of an option is used.
+    if (!packet->option_offsets[code]) {
+      packet->option_offsets[code] = option - buffer;
+    }
+
+    option += (uint8_t) option[1] + 2;
   }
 
-  if (dhcp_message_type + dhcp_request_list < 2) {
-    printf("Warning: Required DHCP options are available, invalid message!\n");
+  if (!packet->option_offsets[DHCP_CODE_MESSAGE_TYPE] || !packet->option_offsets[DHCP_CODE_PARAMETER_REQUEST_LIST]) {
+    WARNING("ntoh_dhcp_packet(...) -> Required DHCP options are missing, invalid message\n");
     return -6;
   }
 
-  packet->options_len = options;
-  packet->options = (dhcp_option*) malloc(sizeof(dhcp_option) * options);
-
-  option = buffer + 236 + 4;
-
-  exit = 0;
-  int i = 0;
-
-  while (option < buffer + len && exit == 0) {
-    switch ((uint8_t) option[0]) {
-    case DHCP_CODE_END:
-      exit = 1;
-
-    case DHCP_CODE_PAD:
-      // JUMP padding and end
-      packet->options[i].code = option[0];
-      packet->options[i].len  = 0;
-      packet->options[i].payload = NULL;
-
-      option += 1;
-      i++;
-      break;
-
-    default:
-      packet->options[i].code = option[0];
-      packet->options[i].len  = option[1];
-      packet->options[i].payload = option + 2;
+#if LOG_LEVEL >= LOG_INFO
 
-      option += (uint8_t) option[1] + 2;
-      i++;
-      break;
-    }
+  if (log_level >= LOG_INFO) {
+    printf_dhcp(packet);
   }
 
-  assert(i == options);
-
-#if LOG_LEVEL >= LOG_INFO
-  printf_dhcp(packet);
 #endif
 
   return 0;
 }
 
-int dhcp_packet_send(int socket, dhcp_packet* packet) {
-  DEBUG("dhcp_packet_send(%i, dhcp_packet)\n", socket);
+// BOOTP header of replies with the magic cookie.
+static const uint8_t dhcp_reply_template[240] = {
+  [0] = 2,
+  [236] = 99, [237] = 130, [238] = 83, [239] = 99,
+};
+
+void dhcp_reply_init(dhcp_reply* reply, uint8_t* buffer, uint16_t size, dhcp_packet* from_client) {
+  DEBUG("dhcp_reply_init(reply, buffer, %i, from_client)\n", size);
+  assert(size > sizeof(dhcp_reply_template));
   uint16_t tmp16;
   uint32_t tmp32;
 
-  uint8_t* buffer = calloc(sizeof(char), _dhcp_packet_len(packet));
+  reply->buffer = buffer;
+  reply->size = size;
+  reply->len = sizeof(dhcp_reply_template);
 
-  // Header
-  buffer[0] = packet->op;
-  buffer[1] = packet->htype;
-  buffer[2] = packet->hlen;
-  buffer[3] = packet->hops;
-  tmp32 = htonl(packet->xid);
+  memcpy(buffer, dhcp_reply_template, sizeof(dhcp_reply_template));
+
+  buffer[1] = from_client->htype;
+  buffer[2] = from_client->hlen;
+  buffer[3] = from_client->hops;
+  tmp32 = htonl(from_client->xid);
   memcpy(buffer + 4, &tmp32, 4);
-  tmp16 = htons(packet->secs);
-  memcpy(buffer + 8, &tmp16, 2);
-  tmp16 = htons(packet->flags);
+  tmp16 = htons(from_client->flags);
   memcpy(buffer + 10, &tmp16, 2);
-  memcpy(buffer + 12 , &packet->ciaddr, 4);
-  memcpy(buffer + 16 , &packet->yiaddr, 4);
-  memcpy(buffer + 20 , &packet->siaddr, 4);
-  memcpy(buffer + 24 , &packet->giaddr, 4);
-  memcpy(buffer + 28 , &packet->chaddr, 16);
-  memcpy(buffer + 44, &packet->sname, 64);
-  memcpy(buffer + 108, &packet->file, 128);
-
-  // Magic Cookie
-  buffer[236] = 99;
-  buffer[237] = 130;
-  buffer[238] = 83;
-  buffer[239] = 99;
-
-  // Options
-  uint8_t* obuf = buffer + 240;
-  dhcp_option* option = packet->options;
-
-  for (int i = 0 ; i < packet->options_len; i++) {
-    obuf[0] = option->code;
-
-    switch (option->code) {
-    case DHCP_CODE_PAD:
-    case DHCP_CODE_END:
-      obuf++;
-      break;
+  memcpy(buffer + 12, &from_client->ciaddr, 4);
+  memcpy(buffer + 24, &from_client->giaddr, 4);
+  memcpy(buffer + 28, &from_client->chaddr, 16);
+}
 
-    default:
-      obuf[1] = option->len;
-      memcpy(obuf + 2, option->payload, option->len);
-      obuf = obuf + 2 + option->len;
-      break;
-    }
+void dhcp_reply_yiaddr(dhcp_reply* reply, struct in_addr* yiaddr) {
+  memcpy(reply->buffer + 16, yiaddr, 4);
+}
 
-    option++;
+int dhcp_reply_option(dhcp_reply* reply, uint8_t code, uint8_t len, uint8_t* payload) {
+  // Keep space for the end option.
+  if (reply->len + 2 + len + 1 > reply->size) {
+    WARNING("dhcp_reply_option(...) -> option %i does not fit into reply\n", code);
+    return 1;
   }
 
-  buffer[_dhcp_packet_len(packet) - 1] = 255;
-  assert(obuf + 1 == buffer + _dhcp_packet_len(packet));
-  // Network send
-  printf("Message LEN: %i\n", _dhcp_packet_len(packet));
+  reply->buffer[reply->len] = code;
+  reply->buffer[reply->len + 1] = len;
+  memcpy(reply->buffer + reply->len + 2, payload, len);
+  reply->len += 2 + len;
 
-  broadcast.sin_port = htons(68);
-
-  int ret = sendto(socket, buffer, _dhcp_packet_len(packet), 0, (struct sockaddr*)&broadcast, sizeof(broadcast));
+  return 0;
+}
 
-  if (ret < 0) {
-    perror("sendto");
-    printf("Err: %i\n", errno);
+int dhcp_reply_options(dhcp_reply* reply, uint8_t* options, uint16_t len) {
+  if (reply->len + len + 1 > reply->size) {
+    WARNING("dhcp_reply_options(...) -> options do not fit into reply\n");
+    return 1;
   }
 
-  free(buffer);
+  memcpy(reply->buffer + reply->len, options, len);
+  reply->len += len;
 
   return 0;
 }
 
-int dhcp_packet_copy(dhcp_packet* dest, dhcp_packet* src) {
-  memcpy(dest, src, sizeof(struct dhcp_packet));
-  dest->options = (struct dhcp_option*) calloc(src->options_len, sizeof(struct dhcp_option));
+int dhcp_reply_send(int socket, dhcp_reply* reply, txqueue* queue) {
+  DEBUG("dhcp_reply_send(%i, reply, queue)\n", socket);
 
-  if (dest->options == NULL) {
-    return 1;
-  }
+  reply->buffer[reply->len] = DHCP_CODE_END;
+  reply->len++;
 
-  dhcp_option* src_option = src->options;
-  dhcp_option* dest_option = dest->options;
+  DEBUG("dhcp_reply_send(...) -> message len %i\n", reply->len);
 
-  for (; src_option < src->options + src->options_len; src_option++) {
-    uint8_t* dest_payload = (uint8_t*) calloc(src_option->len, sizeof(uint8_t));
-    memcpy(dest_payload, src_option->payload, src_option->len);
-    dest_option->code = src_option->code;
-    dest_option->len = src_option->len;
-    dest_option->payload = dest_payload;
-    dest_option++;
-  }
+  broadcast.sin_port = htons(68);
 
-  return 0;
-}
+  txqueue_push(queue, socket, reply->len, (struct sockaddr*) &broadcast, sizeof(broadcast));
 
-int dhcp_packet_list_add(dhcp_packet_list* list, dhcp_packet* packet) {
-  time_t now = time(NULL);
-  // Save dhcp packet, for further actions, later.
-  dhcp_packet_list* tmp = calloc(1, sizeof(dhcp_packet_list));
-  if ( !tmp ) {
-    ERROR("dhcp_packet_list_add( ... ) -> Unable to allocate memory");
-    return 1;
-  }
-  dhcp_packet_copy(&tmp->packet, packet);
-  tmp->packet.timeout = now + 120;
-  list_add_tail((&tmp->list), &(list->list));
   return 0;
 }
 
-dhcp_packet_list* dhcp_packet_list_find(dhcp_packet_list* list, uint32_t xid, uint8_t* chaddr) {
-  DEBUG("dhcp_packet_list_find(list,xid:%u,chaddr)\n", xid);
-  struct list_head* pos, *q;
-  dhcp_packet_list* tmp;
-  time_t now = time(NULL);
-
-  list_for_each_safe(pos, q, &list->list) {
-    tmp = list_entry(pos, dhcp_packet_list, list);
-
-    if (tmp->packet.timeout < now) {
-      // CleanUp
-      dhcp_packet* packet = &tmp->packet;
-      list_del(pos);
-      dhcp_packet_free(packet, 1);
-      free(tmp);
-      DEBUG("dhcp_packet_list_find( ... ): Removing packet from cache\n");
-    } else {
-      if (tmp->packet.xid == xid) {
-        if (memcmp(tmp->packet.chaddr, chaddr, 16) == 0) {
-          DEBUG("dhcp_packet_list_find( ... ) -> packet found\n");
-          return tmp;
-        }
-      } else {
-        DEBUG("dhcp_packet_list_find( ... ): Packet (%u)\n", tmp->packet.xid);
-      }
-    }
+uint8_t* dhcp_packet_option(dhcp_packet* packet, uint8_t code, uint8_t* len) {
+  uint16_t offset = packet->option_offsets[code];
+
+  if (!offset) {
+    return NULL;
   }
-  DEBUG("dhcp_packet_list_find( ... ) -> No matching packet found\n");
-  return NULL;
-}
 
-void dhcp_packet_list_free(dhcp_packet_list* list) {
-  DEBUG("dhcp_packet_list_free(list)\n");
-  struct list_head* pos, *q;
-  dhcp_packet_list* tmp;
-
-  list_for_each_safe(pos, q, &list->list) {
-    tmp = list_entry(pos, dhcp_packet_list, list);
-    dhcp_packet* packet = &tmp->packet;
-    list_del(pos);
-    dhcp_packet_free(packet, 1);
-    free(tmp);
+  if (len) {
+    *len = packet->raw[offset + 1];
   }
+
+  return packet->raw + offset + 2;
 }
 
 uint8_t dhcp_packet_message_type(dhcp_packet* packet) {
-  dhcp_option* option = packet->options;
+  uint8_t len;
+  uint8_t* payload = dhcp_packet_option(packet, DHCP_CODE_MESSAGE_TYPE, &len);
 
-  for (int i = 0; i < packet->options_len; i++) {
-    if (option->code == DHCP_CODE_MESSAGE_TYPE) {
-      return (uint8_t) option->payload[0];
-    }
-
-    option++;
+  if (!payload || len < 1) {
+    return 0;
   }
 
-  return 0;
-}
-
-void dhcp_packet_list_timeout(dhcp_packet_list* list) {
-  DEBUG("dhcp_packet_list_timeout(list)\n");
-  struct list_head* pos, *q;
-  dhcp_packet_list* tmp;
-  time_t now = time(NULL);
-
-  list_for_each_safe(pos, q, &list->list) {
-    tmp = list_entry(pos, dhcp_packet_list, list);
-
-    if (tmp->packet.timeout < now) {
-      dhcp_packet* packet = &tmp->packet;
-      list_del(pos);
-      dhcp_packet_free(packet, 1);
-      free(tmp);
-      DEBUG("dhcp_packet_list_timeout( ... ): drop packet from cache\n");
-    }
-  }
+  return payload[0];
 }
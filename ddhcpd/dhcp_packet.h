@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <netinet/in.h>
+#include "txqueue.h"
 #include "types.h"
 
 struct dhcp_packet {
@@ -22,16 +23,25 @@ struct dhcp_packet {
   int8_t chaddr[16];
   char sname[64];
   char file[128];
-  uint8_t options_len;
-  struct dhcp_option* options;
+  // The datagram the packet was read from.
+  uint8_t* raw;
+  uint16_t raw_len;
+  // Kernel receive timestamp of the datagram, zero iff unknown.
+  struct timespec received;
+  // Offset of the first option with a code in raw, zero iff it is missing.
+  uint16_t option_offsets[256];
 };
 typedef struct dhcp_packet dhcp_packet;
 
-struct dhcp_packet_list {
-  struct dhcp_packet packet;
-  struct list_head list;
+/**
+ * A dhcp reply, encoded in place into a transmit buffer.
+ */
+struct dhcp_reply {
+  uint8_t* buffer;
+  uint16_t size;
+  uint16_t len;
 };
-typedef struct dhcp_packet_list dhcp_packet_list;
+typedef struct dhcp_reply dhcp_reply;
 
 enum dhcp_message_type {
   DHCPDISCOVER  = 1,
@@ -45,57 +55,53 @@ enum dhcp_message_type {
 };
 
 /**
- * Store a packet in the packet_list, create a copy of the packet.
+ * Print an representation of a dhcp_packet to stdout.
  */
-int dhcp_packet_list_add(dhcp_packet_list* list, dhcp_packet* packet);
+void printf_dhcp(dhcp_packet* packet);
 
 /**
- * Search for a packet in the dhcp_packet_list checking chaddr and xid.
+ * Reads and checks a dhcp_packet from buffer. Will return zero on success.
+ * To reduce memory consumption and prevent further memcpy operations this will
+ * make pointer to the buffer inside of the dhcp_packet structure. Do not free
+ * the buffer before the last operation on that struture!
+ * The options are walked once, their offsets are recorded in option_offsets
+ * and no memory is allocated.
  */
-dhcp_packet_list* dhcp_packet_list_find(dhcp_packet_list* list, uint32_t xid, uint8_t* chaddr);
+int ntoh_dhcp_packet(dhcp_packet* packet, uint8_t* buffer, int len);
 
 /**
- * Cleanup the packet list.
+ * Start a reply to from_client in buffer. The BOOTP header is copied from a
+ * template and the fields taken from the client are filled in, the options
+ * are appended afterwards.
  */
-void dhcp_packet_list_timeout(dhcp_packet_list* list);
+void dhcp_reply_init(dhcp_reply* reply, uint8_t* buffer, uint16_t size, dhcp_packet* from_client);
 
-/**
- * Free DHCP packet list
- */
-void dhcp_packet_list_free(dhcp_packet_list* list);
+void dhcp_reply_yiaddr(dhcp_reply* reply, struct in_addr* yiaddr);
 
 /**
- * Print an representation of a dhcp_packet to stdout.
+ * Append an option to the reply. Returns a value greater 0 iff the
+ * option does not fit into the buffer.
  */
-void printf_dhcp(dhcp_packet* packet);
+int dhcp_reply_option(dhcp_reply* reply, uint8_t code, uint8_t len, uint8_t* payload);
 
 /**
- * Memcpy a packet into another packet.
+ * Append already encoded options to the reply. Returns a value greater 0 iff
+ * the options do not fit into the buffer.
  */
-int dhcp_packet_copy(dhcp_packet* dest, dhcp_packet* src);
-
+int dhcp_reply_options(dhcp_reply* reply, uint8_t* options, uint16_t len);
 
 /**
- * Free a packet.
+ * Terminate the options of the reply and queue it for the broadcast to the
+ * clients. The buffer of the reply has to be taken from the queue.
  */
-#define dhcp_packet_free(packet,free_payload) do {\
-    if ( free_payload > 0 ) {\
-      dhcp_option* _option = packet->options;\
-      for (; _option < packet->options + packet->options_len; _option++) {\
-        free(_option->payload);\
-      }\
-    }\
-    free(packet->options);\
-  } while(0)
+int dhcp_reply_send(int socket, dhcp_reply* reply, txqueue* queue);
 
 /**
- * Reads and checks a dhcp_packet from buffer. Will return zero on success.
- * To reduce memory consumption and prevent further memcpy operations this will
- * make pointer to the buffer inside of the dhcp_packet structure. Do not free
- * the buffer before the last operation on that struture!
+ * Return the payload of the option with code in a packet read by
+ * ntoh_dhcp_packet and store its length in len, when len is not NULL.
+ * Returns NULL iff the packet has no such option.
  */
-int ntoh_dhcp_packet(dhcp_packet* packet, uint8_t* buffer, int len);
-int dhcp_packet_send(int socket, dhcp_packet* packet);
+uint8_t* dhcp_packet_option(dhcp_packet* packet, uint8_t code, uint8_t* len);
 
 uint8_t dhcp_packet_message_type(dhcp_packet* packet);
 #endif
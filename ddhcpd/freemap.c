@@ -0,0 +1,120 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freemap.h"
+#include "logger.h"
+
+static void _freemap_tree_add(freemap* map, uint32_t word, int32_t value) {
+  for (uint32_t i = word + 1; i <= map->num_words; i += i & (-i)) {
+    map->tree[i] += value;
+  }
+}
+
+int freemap_init(freemap* map, uint32_t size, int all_free) {
+  DEBUG("freemap_init(map, %u, %i)\n", size, all_free);
+  map->size = size;
+  map->num_words = (size + 63) / 64;
+  map->count = 0;
+  map->words = (uint64_t*) calloc(sizeof(uint64_t), map->num_words);
+  // The tree is one based.
+  map->tree = (uint32_t*) calloc(sizeof(uint32_t), map->num_words + 1);
+
+  if (!map->words || !map->tree) {
+    freemap_free(map);
+    return 1;
+  }
+
+  if (!all_free) {
+    return 0;
+  }
+
+  memset(map->words, 0xff, sizeof(uint64_t) * map->num_words);
+
+  if (size % 64) {
+    map->words[map->num_words - 1] = (((uint64_t) 1) << (size % 64)) - 1;
+  }
+
+  // Build the tree in linear time.
+  for (uint32_t i = 1; i <= map->num_words; i++) {
+    map->tree[i] += __builtin_popcountll(map->words[i - 1]);
+    uint32_t parent = i + (i & (-i));
+
+    if (parent <= map->num_words) {
+      map->tree[parent] += map->tree[i];
+    }
+  }
+
+  map->count = size;
+
+  return 0;
+}
+
+void freemap_free(freemap* map) {
+  free(map->words);
+  free(map->tree);
+  map->words = NULL;
+  map->tree = NULL;
+  map->num_words = 0;
+  map->size = 0;
+  map->count = 0;
+}
+
+void freemap_set(freemap* map, uint32_t index) {
+  assert(index < map->size);
+  uint64_t bit = ((uint64_t) 1) << (index % 64);
+
+  if (map->words[index / 64] & bit) {
+    return;
+  }
+
+  map->words[index / 64] |= bit;
+  map->count++;
+  _freemap_tree_add(map, index / 64, 1);
+}
+
+void freemap_clear(freemap* map, uint32_t index) {
+  assert(index < map->size);
+  uint64_t bit = ((uint64_t) 1) << (index % 64);
+
+  if (!(map->words[index / 64] & bit)) {
+    return;
+  }
+
+  map->words[index / 64] &= ~bit;
+  map->count--;
+  _freemap_tree_add(map, index / 64, -1);
+}
+
+int freemap_test(freemap* map, uint32_t index) {
+  assert(index < map->size);
+  return (map->words[index / 64] >> (index % 64)) & 1;
+}
+
+uint32_t freemap_select(freemap* map, uint32_t k) {
+  assert(k < map->count);
+
+  // Descend the tree to the word holding the k-th free entry.
+  uint32_t pos = 0;
+  uint32_t step = 1;
+
+  while (step <= map->num_words / 2) {
+    step <<= 1;
+  }
+
+  for (; step > 0; step >>= 1) {
+    if (pos + step <= map->num_words && map->tree[pos + step] <= k) {
+      pos += step;
+      k -= map->tree[pos];
+    }
+  }
+
+  // Select the k-th set bit in that word.
+  uint64_t word = map->words[pos];
+
+  while (k--) {
+    word &= word - 1;
+  }
+
+  return pos * 64 + __builtin_ctzll(word);
+}
@@ -0,0 +1,49 @@
+#ifndef _FREEMAP_H
+#define _FREEMAP_H
+
+#include <stdint.h>
+
+/**
+ * A bitmap of free entries with a fenwick tree over the popcount of
+ * every bitmap word. Marking, counting and selecting the k-th free
+ * entry are done without iterating over the whole map and without
+ * any allocation after freemap_init.
+ */
+struct freemap {
+  uint64_t* words;
+  uint32_t* tree;
+  uint32_t num_words;
+  uint32_t size;
+  uint32_t count;
+};
+typedef struct freemap freemap;
+
+/**
+ * Allocate a map for size entries, all entries are marked as free
+ * iff all_free is not 0. Returns a value greater 0 on failure.
+ */
+int freemap_init(freemap* map, uint32_t size, int all_free);
+
+/**
+ * Release the memory of the map.
+ */
+void freemap_free(freemap* map);
+
+/**
+ * Mark entry index as free or used. Marking an entry twice is a no-op.
+ */
+void freemap_set(freemap* map, uint32_t index);
+void freemap_clear(freemap* map, uint32_t index);
+
+/**
+ * Check if entry index is marked as free.
+ */
+int freemap_test(freemap* map, uint32_t index);
+
+/**
+ * Return the index of the k-th free entry, k has to be lower than
+ * map->count.
+ */
+uint32_t freemap_select(freemap* map, uint32_t k);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdio.h>
+
+#include "latency.h"
+
+latency_histogram latency[LATENCY_INTERVALS];
+
+const char* latency_interval_names[LATENCY_INTERVALS] = {
+  "discover_offer", "request_ack_local", "request_ack_remote"
+};
+
+uint64_t latency_bucket_limit(uint32_t bucket) {
+  if (bucket < LATENCY_SUB_BUCKETS) {
+    return bucket;
+  }
+
+  uint32_t exponent = bucket / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+  uint64_t lower = (uint64_t) (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << (exponent - LATENCY_SUB_BITS);
+  return lower + ((uint64_t) 1 << (exponent - LATENCY_SUB_BITS)) - 1;
+}
+
+void latency_record(int interval, const struct timespec* received, const struct timespec* sent) {
+  if (interval < 0 || interval >= LATENCY_INTERVALS || received->tv_sec == 0) {
+    return;
+  }
+
+  int64_t value = (int64_t) (sent->tv_sec - received->tv_sec) * 1000000000 + (sent->tv_nsec - received->tv_nsec);
+
+  // The wall clock may have been set back.
+  if (value < 0) {
+    value = 0;
+  }
+
+  latency_histogram* histogram = &latency[interval];
+  histogram->count++;
+  histogram->sum += value;
+  histogram->buckets[latency_bucket(value)]++;
+
+  if ((uint64_t) value > histogram->max) {
+    histogram->max = value;
+  }
+}
+
+uint64_t latency_percentile(latency_histogram* histogram, uint32_t per_mille) {
+  uint64_t rank = (histogram->count * per_mille + 999) / 1000;
+  uint64_t seen = 0;
+
+  for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+
+    if (seen >= rank && seen > 0) {
+      uint64_t limit = latency_bucket_limit(i);
+      return limit < histogram->max ? limit : histogram->max;
+    }
+  }
+
+  return 0;
+}
+
+void latency_show(int fd) {
+  dprintf(fd, "interval,count,mean_us,p50_us,p90_us,p99_us,max_us\n");
+
+  for (int i = 0; i < LATENCY_INTERVALS; i++) {
+    latency_histogram* histogram = &latency[i];
+    uint64_t mean = histogram->count ? histogram->sum / histogram->count : 0;
+
+    dprintf(fd, "%s,%lu,%lu,%lu,%lu,%lu,%lu\n", latency_interval_names[i],
+            (unsigned long) histogram->count,
+            (unsigned long) mean / 1000,
+            (unsigned long) latency_percentile(histogram, 500) / 1000,
+            (unsigned long) latency_percentile(histogram, 900) / 1000,
+            (unsigned long) latency_percentile(histogram, 990) / 1000,
+            (unsigned long) histogram->max / 1000);
+  }
+
+  dprintf(fd, "interval,le_ns,count\n");
+
+  for (int i = 0; i < LATENCY_INTERVALS; i++) {
+    for (uint32_t k = 0; k < LATENCY_BUCKETS; k++) {
+      if (latency[i].buckets[k]) {
+        dprintf(fd, "%s,%lu,%lu\n", latency_interval_names[i],
+                (unsigned long) latency_bucket_limit(k), (unsigned long) latency[i].buckets[k]);
+      }
+    }
+  }
+}
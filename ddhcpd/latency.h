@@ -0,0 +1,84 @@
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Intervals from the kernel receive timestamp of a DHCP request
+ * to the time its reply is sent.
+ */
+enum latency_interval {
+  // DISCOVER to OFFER.
+  LATENCY_OFFER,
+  // REQUEST to ACK for a lease in one of our blocks.
+  LATENCY_ACK_LOCAL,
+  // REQUEST to ACK for a lease of another node, including the
+  // RENEWLEASE and LEASEACK round-trip to that node.
+  LATENCY_ACK_REMOTE,
+  LATENCY_INTERVALS
+};
+
+// Datagrams which are not timed.
+#define LATENCY_NONE -1
+
+// Each power of two is split into 2^LATENCY_SUB_BITS buckets,
+// so a bucket covers at most 1/8 of its values.
+#define LATENCY_SUB_BITS 3
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+
+// Buckets for nanosecond values up to 2^64.
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+/**
+ * A log-bucketed histogram of nanosecond values, in the spirit of
+ * HdrHistogram: values below LATENCY_SUB_BUCKETS have a bucket of
+ * their own, above that each power of two has LATENCY_SUB_BUCKETS
+ * linear buckets.
+ */
+struct latency_histogram {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[LATENCY_BUCKETS];
+};
+typedef struct latency_histogram latency_histogram;
+
+extern latency_histogram latency[LATENCY_INTERVALS];
+extern const char* latency_interval_names[LATENCY_INTERVALS];
+
+/**
+ * Index of the bucket holding value.
+ */
+static inline uint32_t latency_bucket(uint64_t value) {
+  if (value < LATENCY_SUB_BUCKETS) {
+    return value;
+  }
+
+  int exponent = 63 - __builtin_clzll(value);
+  return (exponent - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + ((value >> (exponent - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+/**
+ * Largest value held by the bucket with index bucket.
+ */
+uint64_t latency_bucket_limit(uint32_t bucket);
+
+/**
+ * Record the time from received to sent for interval. Packets without
+ * a receive timestamp are ignored.
+ */
+void latency_record(int interval, const struct timespec* received, const struct timespec* sent);
+
+/**
+ * Smallest bucket limit below which the given per mille of values are,
+ * capped by the largest value recorded.
+ */
+uint64_t latency_percentile(latency_histogram* histogram, uint32_t per_mille);
+
+/**
+ * Write a summary line for every interval and the non-empty buckets to fd.
+ */
+void latency_show(int fd);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lease_index.h"
+#include "logger.h"
+#include "tools.h"
+#include "types.h"
+
+#define LEASE_INDEX_INITIAL_SLOTS 64
+
+static uint32_t _lease_index_hash(lease_index* index, const uint8_t* chaddr, uint32_t xid) {
+  uint32_t hash = fnv1a(FNV1A_INIT, chaddr, 16);
+
+  if (index->with_xid) {
+    uint8_t xid_bytes[4] = { xid, xid >> 8, xid >> 16, xid >> 24 };
+    hash = fnv1a(hash, xid_bytes, 4);
+  }
+
+  return hash;
+}
+
+static uint32_t _lease_index_home(lease_index* index, dhcp_lease* lease) {
+  return _lease_index_hash(index, lease->chaddr, lease->xid) & index->mask;
+}
+
+static int _lease_index_match(lease_index* index, dhcp_lease* lease, const uint8_t* chaddr, uint32_t xid) {
+  if (index->with_xid && lease->xid != xid) {
+    return 0;
+  }
+
+  return memcmp(lease->chaddr, chaddr, 16) == 0;
+}
+
+static void _lease_index_place(lease_index* index, dhcp_lease* lease) {
+  uint32_t slot = _lease_index_home(index, lease);
+
+  while (index->slots[slot]) {
+    slot = (slot + 1) & index->mask;
+  }
+
+  index->slots[slot] = lease;
+}
+
+static int _lease_index_resize(lease_index* index, uint32_t num_slots) {
+  DEBUG("_lease_index_resize(index, %u)\n", num_slots);
+  dhcp_lease** old_slots = index->slots;
+  uint32_t old_num_slots = index->mask + 1;
+
+  index->slots = (dhcp_lease**) calloc(sizeof(dhcp_lease*), num_slots);
+
+  if (!index->slots) {
+    ERROR("_lease_index_resize(...) -> Unable to allocate memory\n");
+    index->slots = old_slots;
+    return 1;
+  }
+
+  index->mask = num_slots - 1;
+
+  if (old_slots) {
+    for (uint32_t i = 0; i < old_num_slots; i++) {
+      if (old_slots[i]) {
+        _lease_index_place(index, old_slots[i]);
+      }
+    }
+
+    free(old_slots);
+  }
+
+  return 0;
+}
+
+int lease_index_init(lease_index* index, int with_xid) {
+  index->slots = NULL;
+  index->mask = 0;
+  index->count = 0;
+  index->with_xid = with_xid;
+
+  return _lease_index_resize(index, LEASE_INDEX_INITIAL_SLOTS);
+}
+
+void lease_index_free(lease_index* index) {
+  free(index->slots);
+  index->slots = NULL;
+  index->mask = 0;
+  index->count = 0;
+}
+
+int lease_index_insert(lease_index* index, dhcp_lease* lease) {
+  // Keep the load factor below one half.
+  if (2 * (index->count + 1) > index->mask + 1 && _lease_index_resize(index, 2 * (index->mask + 1))) {
+    return 1;
+  }
+
+  _lease_index_place(index, lease);
+  index->count++;
+
+  return 0;
+}
+
+void lease_index_remove(lease_index* index, dhcp_lease* lease) {
+  uint32_t slot = _lease_index_home(index, lease);
+
+  while (index->slots[slot] != lease) {
+    if (!index->slots[slot]) {
+      return;
+    }
+
+    slot = (slot + 1) & index->mask;
+  }
+
+  index->slots[slot] = NULL;
+  index->count--;
+
+  // Shift following entries back, so no probe sequence is interrupted.
+  uint32_t gap = slot;
+
+  for (slot = (slot + 1) & index->mask; index->slots[slot]; slot = (slot + 1) & index->mask) {
+    uint32_t home = _lease_index_home(index, index->slots[slot]);
+
+    // Move the entry iff its home is not cyclically within (gap, slot].
+    if (((slot - home) & index->mask) >= ((slot - gap) & index->mask)) {
+      index->slots[gap] = index->slots[slot];
+      index->slots[slot] = NULL;
+      gap = slot;
+    }
+  }
+}
+
+dhcp_lease* lease_index_find(lease_index* index, const uint8_t* chaddr, uint32_t xid, uint32_t* cursor) {
+  uint32_t slot = *cursor;
+
+  if (slot == LEASE_INDEX_START) {
+    slot = _lease_index_hash(index, chaddr, xid) & index->mask;
+  }
+
+  for (; index->slots[slot]; slot = (slot + 1) & index->mask) {
+    if (_lease_index_match(index, index->slots[slot], chaddr, xid)) {
+      *cursor = (slot + 1) & index->mask;
+      return index->slots[slot];
+    }
+  }
+
+  *cursor = slot;
+  return NULL;
+}
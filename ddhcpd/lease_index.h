@@ -0,0 +1,52 @@
+#ifndef _LEASE_INDEX_H
+#define _LEASE_INDEX_H
+
+#include <stdint.h>
+
+struct dhcp_lease;
+
+/**
+ * An open addressing hash table of leases with linear probing. The keys are
+ * read from the leases themselves, either the chaddr alone or the pair of
+ * chaddr and xid. Equal keys may be stored multiple times, e.g. when a client
+ * holds leases in several blocks.
+ */
+struct lease_index {
+  struct dhcp_lease** slots;
+  // Number of slots minus one, the number of slots is a power of two.
+  uint32_t mask;
+  uint32_t count;
+  // Iff set the xid is part of the key.
+  int with_xid;
+};
+typedef struct lease_index lease_index;
+
+// Initial cursor value for lease_index_find.
+#define LEASE_INDEX_START UINT32_MAX
+
+/**
+ * Prepare an empty index. Returns a value greater 0 on failure.
+ */
+int lease_index_init(lease_index* index, int with_xid);
+
+void lease_index_free(lease_index* index);
+
+/**
+ * Insert a lease with its current chaddr and xid.
+ * Returns a value greater 0 on failure.
+ */
+int lease_index_insert(lease_index* index, struct dhcp_lease* lease);
+
+/**
+ * Remove a lease, its chaddr and xid must not have changed since the insert.
+ */
+void lease_index_remove(lease_index* index, struct dhcp_lease* lease);
+
+/**
+ * Iterate over all leases matching chaddr (and xid iff the index uses it).
+ * The cursor has to be initialized with LEASE_INDEX_START and is advanced
+ * on each call. Returns NULL when no further lease matches.
+ */
+struct dhcp_lease* lease_index_find(lease_index* index, const uint8_t* chaddr, uint32_t xid, uint32_t* cursor);
+
+#endif
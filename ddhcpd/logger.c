@@ -0,0 +1,138 @@
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+int log_level = LOG_LEVEL_DEFAULT;
+
+// The ring is only written and drained by the event loop,
+// so it needs no locking. head and tail run freely and wrap.
+static char log_ring[LOG_RING_SIZE];
+static uint32_t log_head = 0;
+static uint32_t log_tail = 0;
+static uint32_t log_dropped = 0;
+static int log_async = 0;
+
+static void _logger_push(const char* message, uint32_t len) {
+  if (LOG_RING_SIZE - (log_head - log_tail) < len) {
+    log_dropped++;
+    return;
+  }
+
+  uint32_t offset = log_head & (LOG_RING_SIZE - 1);
+  uint32_t first = LOG_RING_SIZE - offset;
+
+  if (first > len) {
+    first = len;
+  }
+
+  memcpy(log_ring + offset, message, first);
+  memcpy(log_ring, message + first, len - first);
+  log_head += len;
+}
+
+void logger_init_async(void) {
+  log_async = 1;
+}
+
+void logger_write(const char* prefix, const char* format, ...) {
+  char line[LOG_LINE_SIZE];
+  va_list args;
+
+  size_t len = strlen(prefix);
+
+  if (len >= LOG_LINE_SIZE) {
+    len = LOG_LINE_SIZE - 1;
+  }
+
+  memcpy(line, prefix, len);
+
+  va_start(args, format);
+  int ret = vsnprintf(line + len, LOG_LINE_SIZE - len, format, args);
+  va_end(args);
+
+  if (ret > 0) {
+    len += (size_t) ret < LOG_LINE_SIZE - len ? (size_t) ret : LOG_LINE_SIZE - len - 1;
+  }
+
+  if (!log_async) {
+    fwrite(line, 1, len, stderr);
+    return;
+  }
+
+  _logger_push(line, len);
+}
+
+void logger_flush(int wait) {
+  if (!log_async) {
+    fflush(stderr);
+    return;
+  }
+
+  if (log_dropped > 0) {
+    char line[64];
+    int len = snprintf(line, sizeof(line), "WARNING: %u log messages dropped\n", log_dropped);
+
+    if (LOG_RING_SIZE - (log_head - log_tail) >= (uint32_t) len) {
+      log_dropped = 0;
+      _logger_push(line, len);
+    }
+  }
+
+  // stderr is shared with other processes, e.g. the terminal of the shell,
+  // so its flags are left alone. Without wait only what stderr accepts
+  // without blocking is written.
+  struct pollfd pfd = { .fd = STDERR_FILENO, .events = POLLOUT };
+
+  while (log_tail != log_head) {
+    uint32_t offset = log_tail & (LOG_RING_SIZE - 1);
+    uint32_t chunk = log_head - log_tail;
+
+    if (chunk > LOG_RING_SIZE - offset) {
+      chunk = LOG_RING_SIZE - offset;
+    }
+
+    if (!wait) {
+      if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLOUT)) {
+        // Keep the rest until stderr accepts more.
+        break;
+      }
+
+      // A writable pipe takes at least PIPE_BUF bytes without blocking.
+      if (chunk > PIPE_BUF) {
+        chunk = PIPE_BUF;
+      }
+    }
+
+    ssize_t written = write(STDERR_FILENO, log_ring + offset, chunk);
+
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (written <= 0) {
+      // stderr is gone, drop what is left.
+      log_tail = log_head;
+      break;
+    }
+
+    log_tail += written;
+  }
+}
+
+int logger_set_level(int level) {
+  if (level > LOG_LEVEL) {
+    return 1;
+  }
+
+  if (level < LOG_FATAL) {
+    level = LOG_FATAL;
+  }
+
+  log_level = level;
+  return 0;
+}
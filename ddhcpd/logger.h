@@ -3,8 +3,14 @@
 
 /**
  * A set of logging function which allow compile time and runtime logging decissions.
+ *
+ * Messages above the compile time LOG_LEVEL are removed, the others are
+ * checked against the runtime level log_level. With an asynchronous logger
+ * messages are formatted into an in-memory ring, which is written out by
+ * logger_flush() once the event loop is idle.
  */
 
+#include <stdint.h>
 #include <stdio.h>
 
 #define LOG_FATAL   0
@@ -13,16 +19,67 @@
 #define LOG_INFO    15
 #define LOG_DEBUG   20
 
+// LOG_LEVEL is the highest level compiled in, LOG_LEVEL_DEFAULT the
+// runtime level at startup. Without LOG_LEVEL all levels are compiled
+// in and warnings are logged, given a LOG_LEVEL it is also the default.
 #ifndef LOG_LEVEL
-#define LOG_LEVEL LOG_WARNING
+#define LOG_LEVEL LOG_DEBUG
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT LOG_WARNING
+#endif
+#endif
+
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT LOG_LEVEL
 #endif
 
+// Size of the log ring, a power of two. Debug builds log a lot more.
+#ifndef LOG_RING_SIZE
+#if LOG_LEVEL_DEFAULT >= LOG_DEBUG
+#define LOG_RING_SIZE (1 << 20)
+#else
+#define LOG_RING_SIZE (1 << 16)
+#endif
+#endif
+
+// Longest message, longer ones are truncated.
+#define LOG_LINE_SIZE 512
+
 #define HEX_NODE_ID(x) ((uint8_t*) x)[0],((uint8_t*) x)[1],((uint8_t*) x)[2],((uint8_t*) x)[3],((uint8_t*) x)[4],((uint8_t*) x)[5],((uint8_t*) x)[6],((uint8_t*) x)[7]
 
+// Runtime log level, messages with a higher level are dropped.
+extern int log_level;
+
+// True iff messages of level are logged, for expensive log preparation.
+#define LOG_ENABLED(level) (LOG_LEVEL >= (level) && log_level >= (level))
+
+/**
+ * Switch to asynchronous logging. Messages are kept in the log ring until
+ * logger_flush() is called.
+ */
+void logger_init_async(void);
+
+/**
+ * Format a message with the given prefix.
+ */
+void logger_write(const char* prefix, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Write the messages in the log ring to stderr, as far as stderr accepts
+ * them without blocking. With wait set all messages are written.
+ */
+void logger_flush(int wait);
+
+/**
+ * Change the runtime log level. Returns a value greater 0 iff level
+ * is not compiled in, the level is left unchanged then.
+ */
+int logger_set_level(int level);
+
 #if LOG_LEVEL >= LOG_FATAL
 #define FATAL(...) do { \
-    fprintf(stderr,"FATAL: "); \
-    fprintf(stderr,__VA_ARGS__); \
+    logger_write("FATAL: ", __VA_ARGS__); \
+    logger_flush(1); \
   } while(0)
 #else
 #define FATAL(...)
@@ -30,8 +87,7 @@
 
 #if LOG_LEVEL >= LOG_ERROR
 #define ERROR(...) do { \
-    fprintf(stderr,"ERROR: "); \
-    fprintf(stderr,__VA_ARGS__); \
+    if (log_level >= LOG_ERROR) logger_write("ERROR: ", __VA_ARGS__); \
   } while(0)
 #else
 #define ERROR(...)
@@ -39,8 +95,7 @@
 
 #if LOG_LEVEL >= LOG_WARNING
 #define WARNING(...) do { \
-    fprintf(stderr,"WARNING: "); \
-    fprintf(stderr,__VA_ARGS__); \
+    if (log_level >= LOG_WARNING) logger_write("WARNING: ", __VA_ARGS__); \
   } while(0)
 #else
 #define WARNING(...)
@@ -48,8 +103,7 @@
 
 #if LOG_LEVEL >= LOG_INFO
 #define INFO(...) do { \
-    fprintf(stderr,"INFO: "); \
-    fprintf(stderr,__VA_ARGS__); \
+    if (log_level >= LOG_INFO) logger_write("INFO: ", __VA_ARGS__); \
   } while(0)
 #else
 #define INFO(...)
@@ -57,8 +111,7 @@
 
 #if LOG_LEVEL >= LOG_DEBUG
 #define DEBUG(...) do { \
-    fprintf(stderr,"DEBUG: "); \
-    fprintf(stderr,__VA_ARGS__); \
+    if (log_level >= LOG_DEBUG) logger_write("DEBUG: ", __VA_ARGS__); \
   } while(0)
 #else
 #define DEBUG(...)
@@ -9,10 +9,13 @@
 #include <sys/socket.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <netdb.h>
 
 #include "block.h"
+#include "clock.h"
 #include "ddhcp.h"
 #include "dhcp.h"
 #include "dhcp_packet.h"
@@ -22,13 +25,15 @@
 #include "tools.h"
 #include "dhcp_options.h"
 #include "control.h"
+#include "metrics.h"
+#include "stats.h"
 
 volatile int daemon_running = 0;
 
 const int NET = 0;
 const int NET_LEN = 10;
 
-struct ddhcp_block* blocks;
+block_table blocks;
 
 void* get_in_addr(struct sockaddr* sa)
 {
@@ -39,27 +44,97 @@ void* get_in_addr(struct sockaddr* sa)
   return &(((struct sockaddr_in6*)sa)->sin6_addr);
 }
 
+/**
+ * Number of blocks we need to claim to keep the configured amount of
+ * spare leases, negative iff we own more blocks than needed.
+ */
+int blocks_needed(ddhcp_config* config) {
+  int spares = block_num_free_leases(config);
+  int spare_blocks = ceil((double) spares / (double) config->block_size);
+  return config->spare_blocks_needed - spare_blocks;
+}
+
+/**
+ * Seconds between two claim rounds, half the tentative timeout.
+ */
+time_t claim_round_interval(ddhcp_config* config) {
+  time_t interval = (config->loop_timeout + 999) / 1000;
+  return interval > 0 ? interval : 1;
+}
+
+/**
+ * Check whether we are short on spare leases and start a claim round,
+ * unless one is scheduled already.
+ */
+void house_keeping_check_claims(ddhcp_config* config, scheduler* sched) {
+  if (!scheduler_pending(sched, SCHEDULE_CLAIM_ROUND) && blocks_needed(config) > 0) {
+    scheduler_set(sched, SCHEDULE_CLAIM_ROUND, clock_now());
+  }
+}
+
 /**
  * House Keeping
  *
- * - Free timed-out DHCP leases.
- * - Refresh timed-out blocks.
+ * Each task is only run when it is due:
+ * - Free timed-out blocks and DHCP leases.
  * + Claim new blocks if we are low on spare leases.
  * + Update our claims.
+ * - Drop expired packets from the dhcp packet cache.
+ * Afterwards the deadlines are updated and the scheduler is armed again.
  */
-void house_keeping(ddhcp_block* blocks, ddhcp_config* config) {
-  DEBUG("house_keeping( blocks, config )\n");
-  block_check_timeouts(blocks, config);
+void house_keeping(block_table* blocks, ddhcp_config* config, scheduler* sched) {
+  time_t now = clock_now();
+  timer_node* node;
+
+  if (scheduler_due(sched, SCHEDULE_EXPIRY, now)) {
+    DEBUG("house_keeping( ... ): expire blocks and leases\n");
+    block_check_timeouts(config);
+    house_keeping_check_claims(config, sched);
+  }
 
-  int spares = block_num_free_leases(blocks, config);
-  int spare_blocks = ceil((double) spares / (double) config->block_size);
-  int blocks_needed = config->spare_blocks_needed - spare_blocks;
+  if (scheduler_due(sched, SCHEDULE_CLAIM_ROUND, now)) {
+    DEBUG("house_keeping( ... ): claim round\n");
+    uint32_t owned = config->num_owned_blocks;
+
+    block_claim(blocks, blocks_needed(config), config);
+
+    // Claims for new blocks are updated at once.
+    if (config->num_owned_blocks != owned) {
+      scheduler_set(sched, SCHEDULE_CLAIM_REFRESH, now);
+    }
+
+    if (config->claiming_blocks_amount > 0 || blocks_needed(config) > 0) {
+      scheduler_set(sched, SCHEDULE_CLAIM_ROUND, now + claim_round_interval(config));
+    }
+  }
+
+  if (scheduler_due(sched, SCHEDULE_CLAIM_REFRESH, now)) {
+    DEBUG("house_keeping( ... ): refresh claims\n");
+    scheduler_set(sched, SCHEDULE_CLAIM_REFRESH, block_update_claims(blocks_needed(config), config));
+  }
+
+  if (scheduler_due(sched, SCHEDULE_CACHE_EXPIRY, now)) {
+    DEBUG("house_keeping( ... ): expire cached packets\n");
+    dhcp_cache_timeout(&config->dhcp_packet_cache);
+  }
+
+  // Timer heaps expire entries with a deadline before now.
+  time_t expiry = 0;
+
+  if ((node = timer_peek(&config->block_timeouts)) != NULL) {
+    expiry = node->deadline + 1;
+  }
+
+  if ((node = timer_peek(&config->lease_timeouts)) != NULL && (expiry == 0 || node->deadline + 1 < expiry)) {
+    expiry = node->deadline + 1;
+  }
+
+  scheduler_set(sched, SCHEDULE_EXPIRY, expiry);
 
-  block_claim(blocks, blocks_needed, config);
-  block_update_claims(blocks, blocks_needed, config);
+  node = timer_peek(&config->dhcp_packet_cache.expiry);
+  scheduler_set(sched, SCHEDULE_CACHE_EXPIRY, node ? node->deadline + 1 : 0);
 
-  dhcp_packet_list_timeout(&config->dhcp_packet_cache);
-  DEBUG("house_keeping( ... ) finish\n\n");
+  scheduler_arm(sched);
 }
 
 void add_fd(int efd, int fd, uint32_t events) {
@@ -80,12 +155,9 @@ void del_fd(int efd, int fd, uint32_t events) {
   event.events = events;
 
   int s = epoll_ctl(efd, EPOLL_CTL_DEL, fd, &event);
-  perror("epoll_ctl");
 
   if (s < 0) {
-    int errsv = errno;
-    printf("%i", errsv);
-    perror("epoll_ctl");
+    FATAL("del_fd(...) -> epoll_ctl: %s\n", strerror(errno));
     exit(1);   //("epoll_ctl");
   }
 }
@@ -122,9 +194,128 @@ void handle_signal_terminate(int sig_nr) {
 }
 
 
+/**
+ * Handle a datagram of the unicast socket, roamed DHCP requests of other nodes.
+ */
+void handle_ddhcp_roaming(uint8_t* buffer, int bytes, struct sockaddr_in6* sender, ddhcp_config* config) {
+  struct ddhcp_mcast_packet packet;
+#if LOG_LEVEL >= LOG_DEBUG
+  char ipv6_sender[INET6_ADDRSTRLEN];
+  DEBUG("Receive message from %s\n",
+        inet_ntop(AF_INET6, get_in_addr((struct sockaddr*)sender), ipv6_sender, INET6_ADDRSTRLEN));
+#endif
+  int ret = ntoh_mcast_packet(buffer, bytes, &packet);
+  packet.sender = sender;
+
+  if (ret == 0) {
+    switch (packet.command) {
+    case DDHCP_MSG_RENEWLEASE:
+      ddhcp_dhcp_renewlease(&blocks, &packet, config);
+      break;
+
+    case DDHCP_MSG_LEASEACK:
+      ddhcp_dhcp_leaseack(&blocks, &packet, config);
+      break;
+
+    case DDHCP_MSG_LEASENAK:
+      ddhcp_dhcp_leasenak(&blocks, &packet, config);
+      break;
+
+    case DDHCP_MSG_RELEASE:
+      ddhcp_dhcp_release(&blocks, &packet, config);
+      break;
+
+    default:
+      break;
+    }
+  } else {
+    stats.ddhcp_parse_errors++;
+    DEBUG("epoll_ret: %i\n", ret);
+  }
+}
+
+/**
+ * Handle a datagram of the multicast socket, the block handling.
+ */
+void handle_ddhcp_blocks(uint8_t* buffer, int bytes, struct sockaddr_in6* sender, ddhcp_config* config) {
+  struct ddhcp_mcast_packet packet;
+#if LOG_LEVEL >= LOG_DEBUG
+  char ipv6_sender[INET6_ADDRSTRLEN];
+  DEBUG("Receive message from %s\n",
+        inet_ntop(AF_INET6, get_in_addr((struct sockaddr*)sender), ipv6_sender, INET6_ADDRSTRLEN));
+#endif
+  int ret = ntoh_mcast_packet(buffer, bytes, &packet);
+  packet.sender = sender;
+
+  if (ret == 0) {
+    switch (packet.command) {
+    case DDHCP_MSG_UPDATECLAIM:
+      ddhcp_block_process_claims(&blocks, &packet, config);
+      break;
+
+    case DDHCP_MSG_INQUIRE:
+      ddhcp_block_process_inquire(&blocks, &packet, config);
+      break;
+
+    default:
+      break;
+    }
+
+    free(packet.payload);
+  } else {
+    stats.ddhcp_parse_errors++;
+    DEBUG("epoll_ret: %i\n", ret);
+  }
+}
+
+/**
+ * Handle a datagram of the client socket. Returns 1 iff we need
+ * house keeping to inquire new blocks, 0 otherwise.
+ */
+int handle_dhcp(uint8_t* buffer, int bytes, struct timespec* received, ddhcp_config* config) {
+  struct dhcp_packet dhcp_packet;
+
+  int ret = ntoh_dhcp_packet(&dhcp_packet, buffer, bytes);
+
+  if (ret != 0) {
+    stats_dhcp_parse_error(ret);
+    return 0;
+  }
+
+  dhcp_packet.received = *received;
+
+  int message_type = dhcp_packet_message_type(&dhcp_packet);
+  stats_dhcp_received(message_type);
+
+  switch (message_type) {
+  case DHCPDISCOVER:
+    if (dhcp_hdl_discover(config->client_socket, &dhcp_packet, config) == 1) {
+      INFO("we need to inquire new blocks\n");
+      return 1;
+    }
+
+    break;
+
+  case DHCPREQUEST:
+    dhcp_hdl_request(config->client_socket, &dhcp_packet, &blocks, config);
+    break;
+
+  case DHCPRELEASE:
+    dhcp_hdl_release(&dhcp_packet, &blocks, config);
+    break;
+
+  default:
+    WARNING("Unknown DHCP message of type: %i\n", message_type);
+    break;
+  }
+
+  return 0;
+}
+
 int main(int argc, char** argv) {
 
   srand(time(NULL));
+  clock_update();
 
   ddhcp_config* config = (ddhcp_config*) calloc(sizeof(ddhcp_config), 1);
   config->block_size = 32;
@@ -133,6 +324,7 @@ int main(int argc, char** argv) {
   inet_aton("10.0.0.0", &config->prefix);
   config->prefix_len = 24;
   config->spare_blocks_needed = 1;
+  config->compact_claims = 0;
   config->block_timeout = 30;
   config->tentative_timeout = 15;
   config->control_path = "/tmp/ddhcpd_ctl";
@@ -143,7 +335,19 @@ int main(int argc, char** argv) {
 
   INIT_LIST_HEAD(&(config->claiming_blocks).list);
 
-  INIT_LIST_HEAD(&(config->dhcp_packet_cache).list);
+  INIT_LIST_HEAD(&config->owned_blocks);
+  timer_heap_init(&config->block_timeouts);
+  timer_heap_init(&config->lease_timeouts);
+
+  if (lease_index_init(&config->lease_clients, 0) || lease_index_init(&config->lease_requests, 1)) {
+    FATAL("Unable to allocate the lease indices\n");
+    abort();
+  }
+
+  if (dhcp_cache_init(&config->dhcp_packet_cache, DHCP_CACHE_CAPACITY)) {
+    FATAL("Unable to allocate the dhcp packet cache\n");
+    abort();
+  }
 
   char* interface = "server0";
   char* interface_client = "client0";
@@ -152,9 +356,11 @@ int main(int argc, char** argv) {
 
   int c;
   int show_usage = 0;
+  int usage_status = 0;
   int early_housekeeping = 0;
+  int metrics_port = 0;
 
-  while ((c = getopt(argc, argv, "C:c:i:t:dDhLb:N:o:s:")) != -1) {
+  while ((c = getopt(argc, argv, "C:c:i:t:dDhLRb:N:o:s:m:")) != -1) {
     switch (c) {
     case 'i':
       interface = optarg;
@@ -189,6 +395,10 @@ int main(int argc, char** argv) {
       early_housekeeping = 1;
       break;
 
+    case 'R':
+      config->compact_claims = 1;
+      break;
+
     case 'N':
       do {
         // TODO Split prefix and cidr
@@ -234,6 +444,23 @@ int main(int argc, char** argv) {
       config->control_path = optarg;
       break;
 
+    case 'm':
+      do {
+        char* end;
+        long port = strtol(optarg, &end, 10);
+
+        if (end == optarg || *end != '\0' || port < 1 || port > 65535) {
+          ERROR("Malformed metrics port '%s'\n", optarg);
+          show_usage = 1;
+          usage_status = 1;
+          break;
+        }
+
+        metrics_port = (int) port;
+      } while (0);
+
+      break;
+
     default:
       printf("ARGC: %i\n", argc);
       show_usage = 1;
@@ -242,7 +469,7 @@ int main(int argc, char** argv) {
   }
 
   if (show_usage) {
-    printf("Usage: ddhcp [-h] [-d|-D] [-L] [-c CLT-IFACE] [-i SRV-IFACE] [-t TENTATIVE-TIMEOUT]\n");
+    printf("Usage: ddhcp [-h] [-d|-D] [-L] [-R] [-c CLT-IFACE] [-i SRV-IFACE] [-t TENTATIVE-TIMEOUT]\n");
     printf("\n");
     printf("-h                   This usage information.\n");
     printf("-c CLT-IFACE         Interface on which requests from clients are handled\n");
@@ -253,10 +480,12 @@ int main(int argc, char** argv) {
     printf("-b BLKSIZEPOW        Power over two of block size\n");
     printf("-s SPAREBLKS         Amount of spare blocks\n");
     printf("-L                   Deactivate learning phase\n");
+    printf("-R                   Announce blocks as runs or bitmaps, every node of the network must support this\n");
     printf("-d                   Run in background and daemonize\n");
     printf("-D                   Run in foreground and log to console (default)\n");
     printf("-C CTRL_PATH         Path to control socket\n");
-    exit(0);
+    printf("-m PORT              Serve Prometheus metrics on 127.0.0.1:PORT (1-65535)\n");
+    exit(usage_status);
   }
 
   config->number_of_blocks = pow(2, (32 - config->prefix_len - ceil(log2(config->block_size))));
@@ -287,7 +516,10 @@ int main(int argc, char** argv) {
   }
 
   // init block stucture
-  ddhcp_block_init(&blocks, config);
+  if (ddhcp_block_init(&blocks, config)) {
+    abort();
+  }
+
   dhcp_options_init(config);
 
   // init network and event loops
@@ -300,10 +532,19 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  metrics_server metrics;
+
+  if (metrics_port > 0 && metrics_open(&metrics, metrics_port)) {
+    return 1;
+  }
+
   uint8_t* buffer = (uint8_t*) malloc(sizeof(uint8_t) * 1500);
-  struct ddhcp_mcast_packet packet;
-  struct dhcp_packet dhcp_packet;
-  int ret = 0, bytes = 0;
+  netsock_batch batch;
+  int bytes = 0, count = 0;
+
+  if (netsock_batch_init(&batch) || txqueue_init(&config->tx_queue)) {
+    return 1;
+  }
 
   int efd;
   int maxevents = 64;
@@ -321,152 +562,92 @@ int main(int argc, char** argv) {
   add_fd(efd, config->client_socket, EPOLLIN | EPOLLET);
   add_fd(efd, config->control_socket, EPOLLIN | EPOLLET);
 
+  if (metrics_port > 0) {
+    add_fd(efd, metrics.socket, EPOLLIN | EPOLLET);
+  }
+
   /* Buffer where events are returned */
   events = calloc(maxevents, sizeof(struct epoll_event));
 
-  uint8_t need_house_keeping;
-  uint32_t loop_timeout = config->loop_timeout = get_loop_timeout(config);
+  config->loop_timeout = get_loop_timeout(config);
+  INFO("claim round interval: %li secs\n", (long) claim_round_interval(config));
 
-  if (early_housekeeping) {
-    loop_timeout = 0;
+  scheduler sched;
+
+  if (scheduler_init(&sched)) {
+    FATAL("Unable to create the house keeping timer\n");
+    abort();
   }
 
-  INFO("loop timeout: %i msecs\n", get_loop_timeout(config));
+  add_fd(efd, sched.fd, EPOLLIN);
 
-  // TODO wait loop_timeout before first time housekeeping
-  do {
-    int n = epoll_wait(efd, events, maxevents, loop_timeout);
+  // Without -L we listen to the network for one claim round interval
+  // before the first claim round.
+  if (early_housekeeping) {
+    scheduler_set(&sched, SCHEDULE_CLAIM_ROUND, clock_now());
+  } else {
+    scheduler_set(&sched, SCHEDULE_CLAIM_ROUND, clock_now() + claim_round_interval(config));
+  }
 
-    if (n < 0) {
-      perror("epoll error:");
-    }
+  scheduler_arm(&sched);
 
-#if LOG_LEVEL >= LOG_DEBUG
+  // From here on log messages are written out, when a round is done.
+  logger_init_async();
 
-    if (loop_timeout != config->loop_timeout) {
-      DEBUG("Increase loop timeout from %i to %i\n", loop_timeout, config->loop_timeout);
-    }
+  do {
+    int n = epoll_wait(efd, events, maxevents, -1);
 
-#endif
+    if (n < 0 && errno != EINTR) {
+      ERROR("epoll_wait: %s\n", strerror(errno));
+    }
 
-    loop_timeout = config->loop_timeout;
-    need_house_keeping = 1;
+    // Everything in this round happens at the same time.
+    clock_update();
 
     for (int i = 0; i < n; i++) {
       if ((events[i].events & EPOLLERR) || (events[i].events & EPOLLHUP)) {
-        fprintf(stderr, "epoll error:%i \n", errno);
-        close(events[i].data.fd);
+        ERROR("epoll error: %i\n", errno);
+
+        if (metrics_port > 0 && metrics_is_client(&metrics, events[i].data.fd)) {
+          metrics_drop(&metrics, events[i].data.fd);
+        } else {
+          close(events[i].data.fd);
+        }
+      } else if (sched.fd == events[i].data.fd) {
+        // Due tasks are run below.
+        scheduler_ack(&sched);
       } else if (config->server_socket == events[i].data.fd) {
         // DDHCP Roamed DHCP Requests
-        struct sockaddr_in6 sender;
-        socklen_t sender_len = sizeof sender;
-        bytes = recvfrom(events[i].data.fd, buffer, 1500, 0, (struct sockaddr*) &sender, &sender_len);
-        // TODO Error Handling
-        #if LOG_LEVEL >= LOG_DEBUG
-        char ipv6_sender[INET6_ADDRSTRLEN];
-        DEBUG("Receive message from %s\n",
-              inet_ntop(AF_INET6, get_in_addr((struct sockaddr*)&sender), ipv6_sender, INET6_ADDRSTRLEN));
-        #endif
-        ret = ntoh_mcast_packet(buffer, bytes, &packet);
-        packet.sender = &sender;
-
-        if (ret == 0) {
-          switch (packet.command) {
-          case DDHCP_MSG_RENEWLEASE:
-            ddhcp_dhcp_renewlease(blocks, &packet, config);
-            break;
-
-          case DDHCP_MSG_LEASEACK:
-            ddhcp_dhcp_leaseack(blocks, &packet, config);
-            break;
-
-          case DDHCP_MSG_LEASENAK:
-            ddhcp_dhcp_leasenak(blocks, &packet, config);
-            break;
-
-          case DDHCP_MSG_RELEASE:
-            ddhcp_dhcp_release(blocks, &packet, config);
-            break;
-
-          default:
-            break;
+        do {
+          count = netsock_recv_batch(&batch, events[i].data.fd);
+
+          for (int k = 0; k < count; k++) {
+            handle_ddhcp_roaming(netsock_batch_data(&batch, k), netsock_batch_len(&batch, k), netsock_batch_sender(&batch, k), config);
           }
-        } else {
-          DEBUG("epoll_ret: %i\n", ret);
-        }
+        } while (count == NETSOCK_BATCH_SIZE);
       } else if (config->mcast_socket == events[i].data.fd) {
         // DDHCP Block Handling
-        struct sockaddr_in6 sender;
-        socklen_t sender_len = sizeof sender;
-        bytes = recvfrom(events[i].data.fd, buffer, 1500, 0, (struct sockaddr*) &sender, &sender_len);
-        // TODO Error Handling
-        #if LOG_LEVEL >= LOG_DEBUG
-        char ipv6_sender[INET6_ADDRSTRLEN];
-        DEBUG("Receive message from %s\n",
-              inet_ntop(AF_INET6, get_in_addr((struct sockaddr*)&sender), ipv6_sender, INET6_ADDRSTRLEN));
-        #endif
-        ret = ntoh_mcast_packet(buffer, bytes, &packet);
-        packet.sender = &sender;
-
-        if (ret == 0) {
-          switch (packet.command) {
-          case DDHCP_MSG_UPDATECLAIM:
-            ddhcp_block_process_claims(blocks, &packet, config);
-            break;
-
-          case DDHCP_MSG_INQUIRE:
-            ddhcp_block_process_inquire(blocks, &packet, config);
-            break;
-
-          default:
-            break;
-          }
-
-          free(packet.payload);
-        } else {
-          DEBUG("epoll_ret: %i\n", ret);
-        }
+        do {
+          count = netsock_recv_batch(&batch, events[i].data.fd);
 
-        house_keeping(blocks, config);
-        need_house_keeping = 0;
+          for (int k = 0; k < count; k++) {
+            handle_ddhcp_blocks(netsock_batch_data(&batch, k), netsock_batch_len(&batch, k), netsock_batch_sender(&batch, k), config);
+          }
+        } while (count == NETSOCK_BATCH_SIZE);
       } else if (config->client_socket == events[i].data.fd) {
         // DHCP
-        bytes = read(config->client_socket, buffer, 1500);
-
-        // TODO Error Handling
-        ret = ntoh_dhcp_packet(&dhcp_packet, buffer, bytes);
-
-        if (ret == 0) {
-          int message_type = dhcp_packet_message_type(&dhcp_packet);
-
-          switch (message_type) {
-          case DHCPDISCOVER:
-            ret = dhcp_hdl_discover(config->client_socket, &dhcp_packet, blocks, config);
-
-            if (ret == 1) {
-              INFO("we need to inquire new blocks\n");
-              need_house_keeping = 1;
-            }
+        do {
+          count = netsock_recv_batch(&batch, events[i].data.fd);
 
-            break;
-
-          case DHCPREQUEST:
-            dhcp_hdl_request(config->client_socket, &dhcp_packet, blocks, config);
-            break;
-
-          case DHCPRELEASE:
-            dhcp_hdl_release(&dhcp_packet, blocks, config);
-            break;
-
-          default:
-            WARNING("Unknown DHCP message of type: %i\n", message_type);
-            break;
+          for (int k = 0; k < count; k++) {
+            struct timespec received;
+            netsock_batch_stamp(&batch, k, &received);
+            handle_dhcp(netsock_batch_data(&batch, k), netsock_batch_len(&batch, k), &received, config);
           }
+        } while (count == NETSOCK_BATCH_SIZE);
 
-          if (dhcp_packet.options_len > 0) {
-            free(dhcp_packet.options);
-          }
-        }
+        // Leases have been handed out, we may be short on spare leases.
+        house_keeping_check_claims(config, &sched);
       } else if (config->control_socket == events[i].data.fd) {
         // Handle new control socket connections
         struct sockaddr_un client_fd;
@@ -475,11 +656,21 @@ int main(int argc, char** argv) {
         //set_nonblocking(config->client_control_socket);
         add_fd(efd, config->client_control_socket, EPOLLIN | EPOLLET);
         DEBUG("ControlSocket: new connections\n");
+      } else if (metrics_port > 0 && metrics.socket == events[i].data.fd) {
+        // Handle new metrics connections
+        int fd;
+
+        while ((fd = metrics_accept(&metrics)) >= 0) {
+          add_fd(efd, fd, EPOLLIN);
+        }
+      } else if (metrics_port > 0 && metrics_is_client(&metrics, events[i].data.fd)) {
+        // Answer scrapes, the connection is closed afterwards
+        metrics_handle(&metrics, events[i].data.fd, config);
       } else if (events[i].events & EPOLLIN) {
         // Handle commands comming over a control_socket
         bytes = read(events[i].data.fd, buffer, 1500);
 
-        if (handle_command(events[i].data.fd, buffer, bytes, blocks, config) < 0) {
+        if (handle_command(events[i].data.fd, buffer, bytes, &blocks, config) < 0) {
           ERROR("Malformed command\n");
         }
 
@@ -491,34 +682,45 @@ int main(int argc, char** argv) {
       }
     }
 
-    if (need_house_keeping) {
-      house_keeping(blocks, config);
-    }
+    house_keeping(&blocks, config, &sched);
+
+    txqueue_flush(&config->tx_queue);
+    logger_flush(0);
   } while (daemon_running);
 
   // TODO free dhcp_leases
   free(events);
 
-  ddhcp_block* block = blocks;
-
-  for (uint32_t i = 0; i < config->number_of_blocks; i++) {
-    block_free(block++);
-  }
+  block_table_free(&blocks, config);
 
   block_free_claims(config);
 
-  free(blocks);
+  timer_heap_free(&config->block_timeouts);
+  timer_heap_free(&config->lease_timeouts);
+  lease_index_free(&config->lease_clients);
+  lease_index_free(&config->lease_requests);
+  freemap_free(&config->free_blocks);
+  slab_free(&config->lease_slab);
   free(buffer);
+  netsock_batch_free(&batch);
+  txqueue_free(&config->tx_queue);
+  scheduler_free(&sched);
 
   free_option_store(&config->options);
-  dhcp_packet_list_free(&config->dhcp_packet_cache);
+  dhcp_cache_free(&config->dhcp_packet_cache);
 
   close(config->mcast_socket);
   close(config->client_socket);
   close(config->control_socket);
 
+  if (metrics_port > 0) {
+    metrics_close(&metrics);
+  }
+
   remove(config->control_path);
 
   free(config);
+
+  logger_flush(1);
   return 0;
 }
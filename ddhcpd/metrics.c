@@ -0,0 +1,292 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "latency.h"
+#include "logger.h"
+#include "metrics.h"
+#include "stats.h"
+
+// Room for the HTTP header in front of the rendered metrics.
+#define METRICS_HEADER_SIZE 256
+
+static const char* metrics_block_state_names[DDHCP_BLOCK_STATES] = {
+  "free", "tentative", "claimed", "claiming", "ours", "blocked"
+};
+
+static const char* metrics_lease_state_names[DHCP_LEASE_STATES] = {
+  "free", "offered", "leased"
+};
+
+static void _metrics_printf(char* buffer, int size, int* len, const char* format, ...) __attribute__((format(printf, 4, 5)));
+
+static void _metrics_printf(char* buffer, int size, int* len, const char* format, ...) {
+  va_list args;
+
+  if (*len >= size) {
+    return;
+  }
+
+  va_start(args, format);
+  int ret = vsnprintf(buffer + *len, size - *len, format, args);
+  va_end(args);
+
+  if (ret > 0) {
+    *len += ret;
+  }
+}
+
+int metrics_open(metrics_server* server, uint16_t port) {
+  DEBUG("metrics_open(server, %u)\n", port);
+  struct sockaddr_in sin = {
+    .sin_family = AF_INET,
+    .sin_port = htons(port),
+    .sin_addr = { htonl(INADDR_LOOPBACK) },
+  };
+  int enable = 1;
+
+  for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+    server->clients[i] = -1;
+  }
+
+  server->buffer = (char*) malloc(METRICS_HEADER_SIZE + METRICS_BUFFER_SIZE);
+
+  if (!server->buffer) {
+    ERROR("metrics_open(...) -> Unable to allocate memory\n");
+    return 1;
+  }
+
+  server->socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (server->socket < 0) {
+    ERROR("metrics_open(...) -> Unable to create socket: %s\n", strerror(errno));
+    free(server->buffer);
+    return 1;
+  }
+
+  setsockopt(server->socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  if (bind(server->socket, (struct sockaddr*) &sin, sizeof(sin)) < 0 || listen(server->socket, METRICS_MAX_CLIENTS) < 0) {
+    ERROR("metrics_open(...) -> Unable to listen on port %u: %s\n", port, strerror(errno));
+    close(server->socket);
+    free(server->buffer);
+    return 1;
+  }
+
+  return 0;
+}
+
+void metrics_close(metrics_server* server) {
+  for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+    if (server->clients[i] >= 0) {
+      close(server->clients[i]);
+      server->clients[i] = -1;
+    }
+  }
+
+  close(server->socket);
+  free(server->buffer);
+  server->buffer = NULL;
+}
+
+int metrics_accept(metrics_server* server) {
+  int fd;
+
+  // The listener is edge triggered, so overflow connections are closed
+  // until the backlog is empty instead of ending the accept loop.
+  while ((fd = accept4(server->socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+      if (server->clients[i] < 0) {
+        server->clients[i] = fd;
+        // The whole response is sent at once, without waiting for the client.
+        int size = METRICS_HEADER_SIZE + METRICS_BUFFER_SIZE;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        return fd;
+      }
+    }
+
+    WARNING("metrics_accept(...) -> Too many connections\n");
+    close(fd);
+  }
+
+  return -1;
+}
+
+int metrics_is_client(metrics_server* server, int fd) {
+  for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+    if (server->clients[i] == fd) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void metrics_drop(metrics_server* server, int fd) {
+  for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+    if (server->clients[i] == fd) {
+      server->clients[i] = -1;
+    }
+  }
+
+  close(fd);
+}
+
+void metrics_handle(metrics_server* server, int fd, ddhcp_config* config) {
+  DEBUG("metrics_handle(server, %i, config)\n", fd);
+  char request[1024];
+  ssize_t bytes = 0;
+  ssize_t ret;
+
+  // Any request is answered with the metrics, its content is not checked.
+  while ((ret = recv(fd, request, sizeof(request), MSG_DONTWAIT)) > 0) {
+    bytes += ret;
+  }
+
+  if (bytes == 0) {
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+
+    metrics_drop(server, fd);
+    return;
+  }
+
+  char* body = server->buffer + METRICS_HEADER_SIZE;
+  int len = metrics_render(body, METRICS_BUFFER_SIZE, config);
+
+  char header[METRICS_HEADER_SIZE];
+  int header_len = snprintf(header, sizeof(header),
+                            "HTTP/1.0 200 OK\r\n"
+                            "Content-Type: text/plain; version=0.0.4\r\n"
+                            "Content-Length: %i\r\n"
+                            "Connection: close\r\n\r\n", len);
+
+  char* response = body - header_len;
+  memcpy(response, header, header_len);
+  len += header_len;
+
+  while (len > 0) {
+    ret = send(fd, response, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (ret <= 0) {
+      WARNING("metrics_handle(...) -> Response truncated\n");
+      break;
+    }
+
+    response += ret;
+    len -= ret;
+  }
+
+  metrics_drop(server, fd);
+}
+
+int metrics_render(char* buffer, int size, ddhcp_config* config) {
+  int len = 0;
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_blocks Blocks by state.\n# TYPE ddhcpd_blocks gauge\n");
+
+  for (int i = 0; i < DDHCP_BLOCK_STATES; i++) {
+    _metrics_printf(buffer, size, &len, "ddhcpd_blocks{state=\"%s\"} %u\n", metrics_block_state_names[i], config->num_blocks[i]);
+  }
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_block_size Addresses per block.\n# TYPE ddhcpd_block_size gauge\n");
+  _metrics_printf(buffer, size, &len, "ddhcpd_block_size %u\n", config->block_size);
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_leases Leases of our blocks by state.\n# TYPE ddhcpd_leases gauge\n");
+
+  for (int i = 0; i < DHCP_LEASE_STATES; i++) {
+    _metrics_printf(buffer, size, &len, "ddhcpd_leases{state=\"%s\"} %u\n", metrics_lease_state_names[i], config->num_leases[i]);
+  }
+
+  uint32_t capacity = config->num_owned_blocks * config->block_size;
+  double utilisation = capacity ? (double) (config->num_leases[OFFERED] + config->num_leases[LEASED]) / capacity : 0;
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_lease_utilisation Share of the leases of our blocks in use.\n# TYPE ddhcpd_lease_utilisation gauge\n");
+  _metrics_printf(buffer, size, &len, "ddhcpd_lease_utilisation %g\n", utilisation);
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_packet_cache_entries DHCP requests waiting for a remote lease ack.\n# TYPE ddhcpd_packet_cache_entries gauge\n");
+  _metrics_printf(buffer, size, &len, "ddhcpd_packet_cache_entries %u\n", config->dhcp_packet_cache.count);
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_packet_cache_capacity Size of the DHCP request cache.\n# TYPE ddhcpd_packet_cache_capacity gauge\n");
+  _metrics_printf(buffer, size, &len, "ddhcpd_packet_cache_capacity %u\n", config->dhcp_packet_cache.capacity);
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_packet_cache_lookups_total Lookups in the DHCP request cache.\n# TYPE ddhcpd_packet_cache_lookups_total counter\n");
+  _metrics_printf(buffer, size, &len, "ddhcpd_packet_cache_lookups_total{result=\"hit\"} %lu\n", (unsigned long) stats.cache_hits);
+  _metrics_printf(buffer, size, &len, "ddhcpd_packet_cache_lookups_total{result=\"miss\"} %lu\n", (unsigned long) stats.cache_misses);
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_claim_rounds_total Claim rounds run.\n# TYPE ddhcpd_claim_rounds_total counter\n");
+  _metrics_printf(buffer, size, &len, "ddhcpd_claim_rounds_total %lu\n", (unsigned long) stats.claim_rounds);
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_claims_total Blocks we claimed or another node claimed first.\n# TYPE ddhcpd_claims_total counter\n");
+  _metrics_printf(buffer, size, &len, "ddhcpd_claims_total{result=\"won\"} %lu\n", (unsigned long) stats.claims_won);
+  _metrics_printf(buffer, size, &len, "ddhcpd_claims_total{result=\"lost\"} %lu\n", (unsigned long) stats.claims_lost);
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_dhcp_messages_total DHCP messages by direction and type.\n# TYPE ddhcpd_dhcp_messages_total counter\n");
+
+  for (int i = 0; i < STATS_DHCP_TYPES; i++) {
+    _metrics_printf(buffer, size, &len, "ddhcpd_dhcp_messages_total{direction=\"received\",type=\"%s\"} %lu\n", stats_dhcp_type_names[i], (unsigned long) stats.dhcp_received[i]);
+  }
+
+  for (int i = 0; i < STATS_DHCP_TYPES; i++) {
+    _metrics_printf(buffer, size, &len, "ddhcpd_dhcp_messages_total{direction=\"sent\",type=\"%s\"} %lu\n", stats_dhcp_type_names[i], (unsigned long) stats.dhcp_sent[i]);
+  }
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_dhcp_parse_errors_total Malformed DHCP messages by error code.\n# TYPE ddhcpd_dhcp_parse_errors_total counter\n");
+
+  for (int i = 0; i < STATS_DHCP_ERRORS; i++) {
+    _metrics_printf(buffer, size, &len, "ddhcpd_dhcp_parse_errors_total{code=\"%i\"} %lu\n", -i, (unsigned long) stats.dhcp_parse_errors[i]);
+  }
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_ddhcp_messages_total DDHCP datagrams by direction and command.\n# TYPE ddhcpd_ddhcp_messages_total counter\n");
+
+  for (int i = 0; i < STATS_DDHCP_COMMANDS; i++) {
+    if (stats_ddhcp_command_names[i]) {
+      _metrics_printf(buffer, size, &len, "ddhcpd_ddhcp_messages_total{direction=\"received\",command=\"%s\"} %lu\n", stats_ddhcp_command_names[i], (unsigned long) stats.ddhcp_received[i]);
+      _metrics_printf(buffer, size, &len, "ddhcpd_ddhcp_messages_total{direction=\"sent\",command=\"%s\"} %lu\n", stats_ddhcp_command_names[i], (unsigned long) stats.ddhcp_sent[i]);
+    }
+  }
+
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_ddhcp_parse_errors_total Malformed DDHCP datagrams.\n# TYPE ddhcpd_ddhcp_parse_errors_total counter\n");
+  _metrics_printf(buffer, size, &len, "ddhcpd_ddhcp_parse_errors_total %lu\n", (unsigned long) stats.ddhcp_parse_errors);
+
+  // The histograms are reduced to buckets at powers of four nanoseconds,
+  // from 16us to 17s.
+  _metrics_printf(buffer, size, &len, "# HELP ddhcpd_reply_latency_seconds Time from receiving a DHCP request to sending the reply.\n# TYPE ddhcpd_reply_latency_seconds histogram\n");
+
+  for (int i = 0; i < LATENCY_INTERVALS; i++) {
+    latency_histogram* histogram = &latency[i];
+    uint64_t seen = 0;
+    uint32_t bucket = 0;
+
+    for (int exponent = 14; exponent <= 34; exponent += 2) {
+      uint32_t end = latency_bucket((uint64_t) 1 << exponent);
+
+      for (; bucket < end; bucket++) {
+        seen += histogram->buckets[bucket];
+      }
+
+      _metrics_printf(buffer, size, &len, "ddhcpd_reply_latency_seconds_bucket{interval=\"%s\",le=\"%g\"} %lu\n",
+                      latency_interval_names[i], (double) ((uint64_t) 1 << exponent) / 1e9, (unsigned long) seen);
+    }
+
+    _metrics_printf(buffer, size, &len, "ddhcpd_reply_latency_seconds_bucket{interval=\"%s\",le=\"+Inf\"} %lu\n", latency_interval_names[i], (unsigned long) histogram->count);
+    _metrics_printf(buffer, size, &len, "ddhcpd_reply_latency_seconds_sum{interval=\"%s\"} %g\n", latency_interval_names[i], (double) histogram->sum / 1e9);
+    _metrics_printf(buffer, size, &len, "ddhcpd_reply_latency_seconds_count{interval=\"%s\"} %lu\n", latency_interval_names[i], (unsigned long) histogram->count);
+  }
+
+  if (len >= size) {
+    WARNING("metrics_render(...) -> Metrics truncated\n");
+    len = size - 1;
+  }
+
+  return len;
+}
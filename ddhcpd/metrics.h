@@ -0,0 +1,61 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdint.h>
+
+#include "types.h"
+
+// Connections of scrapers served at the same time.
+#define METRICS_MAX_CLIENTS 8
+
+// Size of the rendered response, large enough for all metrics.
+#define METRICS_BUFFER_SIZE 32768
+
+/**
+ * A minimal HTTP endpoint on a loopback TCP port, which serves the metrics
+ * of the daemon in the Prometheus text format. The metrics are rendered
+ * from counters maintained as the daemon runs, a scrape never walks the
+ * blocks or leases.
+ */
+struct metrics_server {
+  int socket;
+  // Accepted connections waiting for their request, -1 for unused slots.
+  int clients[METRICS_MAX_CLIENTS];
+  char* buffer;
+};
+typedef struct metrics_server metrics_server;
+
+/**
+ * Listen on 127.0.0.1:port. Returns a value greater 0 on failure.
+ */
+int metrics_open(metrics_server* server, uint16_t port);
+void metrics_close(metrics_server* server);
+
+/**
+ * Accept a pending connection. Connections beyond METRICS_MAX_CLIENTS are
+ * closed. Returns its socket or -1, iff there is none left.
+ */
+int metrics_accept(metrics_server* server);
+
+/**
+ * Return 1 iff fd is a connection accepted by the server.
+ */
+int metrics_is_client(metrics_server* server, int fd);
+
+/**
+ * Read the request of a client, answer it with the metrics and
+ * close the connection.
+ */
+void metrics_handle(metrics_server* server, int fd, ddhcp_config* config);
+
+/**
+ * Forget and close the connection of a client.
+ */
+void metrics_drop(metrics_server* server, int fd);
+
+/**
+ * Render all metrics into buffer, returns the length of the text.
+ */
+int metrics_render(char* buffer, int size, ddhcp_config* config);
+
+#endif
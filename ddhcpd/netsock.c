@@ -36,6 +36,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include "logger.h"
 #include "netsock.h"
 #include "packet.h"
 
@@ -121,6 +122,7 @@ int netsock_open(char* interface, char* interface_client, ddhcp_config* state)
   struct ipv6_mreq mreq;
   unsigned int mloop = 0;
   unsigned int broadcast = 1;
+  int enable = 1;
   struct ifreq ifr;
   int ret;
 
@@ -271,6 +273,12 @@ int netsock_open(char* interface, char* interface_client, ddhcp_config* state)
     goto err;
   }
 
+  // Kernel receive timestamps of DHCP requests, for latency histograms
+
+  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable))) {
+    WARNING("netsock_open(...) -> Unable to enable receive timestamps\n");
+  }
+
   // Broadcast Options for DHCP 
 
   if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(unsigned int))) {
@@ -334,3 +342,65 @@ err:
   close(sock_mc);
   return -1;
 }
+
+int netsock_batch_init(netsock_batch* batch) {
+  batch->buffers = (uint8_t*) malloc(NETSOCK_BATCH_SIZE * NETSOCK_BUFFER_SIZE);
+
+  if (!batch->buffers) {
+    ERROR("netsock_batch_init(...) -> Unable to allocate memory\n");
+    return 1;
+  }
+
+  memset(batch->msgs, 0, sizeof(batch->msgs));
+
+  for (int i = 0; i < NETSOCK_BATCH_SIZE; i++) {
+    batch->iovecs[i].iov_base = netsock_batch_data(batch, i);
+    batch->iovecs[i].iov_len = NETSOCK_BUFFER_SIZE;
+    batch->msgs[i].msg_hdr.msg_iov = &batch->iovecs[i];
+    batch->msgs[i].msg_hdr.msg_iovlen = 1;
+    batch->msgs[i].msg_hdr.msg_name = &batch->senders[i];
+    batch->msgs[i].msg_hdr.msg_control = batch->controls[i];
+  }
+
+  return 0;
+}
+
+void netsock_batch_free(netsock_batch* batch) {
+  free(batch->buffers);
+  batch->buffers = NULL;
+}
+
+int netsock_recv_batch(netsock_batch* batch, int socket) {
+  for (int i = 0; i < NETSOCK_BATCH_SIZE; i++) {
+    batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+    batch->msgs[i].msg_hdr.msg_controllen = sizeof(batch->controls[i]);
+  }
+
+  int count = recvmmsg(socket, batch->msgs, NETSOCK_BATCH_SIZE, MSG_DONTWAIT, NULL);
+
+  if (count < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      ERROR("netsock_recv_batch(...) -> recvmmsg failed: %s\n", strerror(errno));
+    }
+
+    return 0;
+  }
+
+  DEBUG("netsock_recv_batch(batch, %i) -> %i datagrams\n", socket, count);
+
+  return count;
+}
+
+void netsock_batch_stamp(netsock_batch* batch, int i, struct timespec* received) {
+  struct msghdr* hdr = &batch->msgs[i].msg_hdr;
+
+  received->tv_sec = 0;
+  received->tv_nsec = 0;
+
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy(received, CMSG_DATA(cmsg), sizeof(struct timespec));
+      break;
+    }
+  }
+}
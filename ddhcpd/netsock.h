@@ -1,13 +1,56 @@
 #ifndef _NETSOCK_H
 #define _NETSOCK_H
 
+#include <sys/socket.h>
+#include <time.h>
+
 #include "types.h"
 
 #define DDHCP_MULTICAST_PORT 1234
 #define DDHCP_UNICAST_PORT 1235
 
+// Number of datagrams read with a single recvmmsg call.
+#define NETSOCK_BATCH_SIZE 32
+#define NETSOCK_BUFFER_SIZE 1500
+
+/**
+ * A ring of preallocated receive buffers, filled by netsock_recv_batch.
+ */
+struct netsock_batch {
+  uint8_t* buffers;
+  struct mmsghdr msgs[NETSOCK_BATCH_SIZE];
+  struct iovec iovecs[NETSOCK_BATCH_SIZE];
+  struct sockaddr_in6 senders[NETSOCK_BATCH_SIZE];
+  // Ancillary data, the receive timestamps of sockets with SO_TIMESTAMPNS.
+  uint8_t controls[NETSOCK_BATCH_SIZE][CMSG_SPACE(sizeof(struct timespec))];
+};
+typedef struct netsock_batch netsock_batch;
+
+#define netsock_batch_data(batch, i) ((batch)->buffers + (i) * NETSOCK_BUFFER_SIZE)
+#define netsock_batch_len(batch, i) ((int) (batch)->msgs[i].msg_len)
+#define netsock_batch_sender(batch, i) (&(batch)->senders[i])
+
 int control_open(ddhcp_config* state);
 int control_connect(ddhcp_config* state);
 int netsock_open(char* interface, char* interface_client, ddhcp_config* state);
 
+/**
+ * Allocate the buffers of a batch. Returns a value greater 0 on failure.
+ */
+int netsock_batch_init(netsock_batch* batch);
+void netsock_batch_free(netsock_batch* batch);
+
+/**
+ * Read up to NETSOCK_BATCH_SIZE pending datagrams from the non blocking
+ * socket into the batch and return their number. Less than NETSOCK_BATCH_SIZE
+ * datagrams are returned iff the socket is drained.
+ */
+int netsock_recv_batch(netsock_batch* batch, int socket);
+
+/**
+ * Store the kernel receive timestamp of the i-th datagram of the batch
+ * in received. It is zero iff the datagram has no timestamp.
+ */
+void netsock_batch_stamp(netsock_batch* batch, int i, struct timespec* received);
+
 #endif
@@ -1,10 +1,12 @@
 #include "packet.h"
 #include "logger.h"
 #include "netsock.h"
+#include "stats.h"
 
 #include <endian.h>
 #include <assert.h>
 #include <errno.h>
+#include <stdlib.h>
 
 #define copy_buf_to_var_inc(buf, type, var)             \
   do {                                                  \
@@ -32,6 +34,24 @@ int _packet_size(int command, int payload_count) {
     len = 16 + payload_count * 4;
     break;
 
+  // The count is the number of runs.
+  case DDHCP_MSG_UPDATECLAIM_RANGES:
+    len = 16 + payload_count * 8;
+    break;
+
+  case DDHCP_MSG_INQUIRE_RANGES:
+    len = 16 + payload_count * 6;
+    break;
+
+  // The count is the number of bytes of the bitmap.
+  case DDHCP_MSG_UPDATECLAIM_BITMAP:
+    len = 16 + 6 + payload_count;
+    break;
+
+  case DDHCP_MSG_INQUIRE_BITMAP:
+    len = 16 + 4 + payload_count;
+    break;
+
   case DDHCP_MSG_LEASEACK:
   case DDHCP_MSG_LEASENAK:
   case DDHCP_MSG_RENEWLEASE:
@@ -40,7 +60,7 @@ int _packet_size(int command, int payload_count) {
     break;
 
   default:
-    printf("Error: unknown command: %i/%i \n", command, payload_count);
+    ERROR("_packet_size(...) -> unknown command: %i/%i\n", command, payload_count);
     return -1;
     break;
   }
@@ -52,6 +72,36 @@ int _packet_size(int command, int payload_count) {
   return len;
 }
 
+/**
+ * Number of payload entries of a command which fit into one datagram.
+ */
+uint32_t _packet_max_count(int command) {
+  uint32_t max_count = DDHCP_MAX_PAYLOAD_COUNT;
+
+  switch (command) {
+  case DDHCP_MSG_UPDATECLAIM:
+    max_count = (DDHCP_MAX_DATAGRAM_SIZE - 16) / 7;
+    break;
+
+  case DDHCP_MSG_INQUIRE:
+    max_count = (DDHCP_MAX_DATAGRAM_SIZE - 16) / 4;
+    break;
+
+  case DDHCP_MSG_UPDATECLAIM_RANGES:
+    max_count = (DDHCP_MAX_DATAGRAM_SIZE - 16) / 8;
+    break;
+
+  case DDHCP_MSG_INQUIRE_RANGES:
+    max_count = (DDHCP_MAX_DATAGRAM_SIZE - 16) / 6;
+    break;
+
+  default:
+    break;
+  }
+
+  return max_count < DDHCP_MAX_PAYLOAD_COUNT ? max_count : DDHCP_MAX_PAYLOAD_COUNT;
+}
+
 struct ddhcp_mcast_packet* new_ddhcp_packet(int command, ddhcp_config* config) {
   struct ddhcp_mcast_packet* packet = (struct ddhcp_mcast_packet*) calloc(sizeof(struct ddhcp_mcast_packet), 1);
   // TODO Check we actually got the memory
@@ -61,6 +111,7 @@ struct ddhcp_mcast_packet* new_ddhcp_packet(int command, ddhcp_config* config) {
   packet->prefix_len = config->prefix_len;
   packet->blocksize = config->block_size;
   packet->command = command;
+  packet->compact = config->compact_claims;
   packet->sender = NULL;
 
   return packet;
@@ -82,18 +133,22 @@ int ntoh_mcast_packet(uint8_t* buffer, int len, struct ddhcp_mcast_packet* packe
   // the command
   copy_buf_to_var_inc(buffer, uint8_t, packet->command);
   // count of payload entries
-  copy_buf_to_var_inc(buffer, uint8_t, packet->count);
+  uint8_t count;
+  copy_buf_to_var_inc(buffer, uint8_t, count);
+  packet->count = count;
 
   int should_len = _packet_size(packet->command, packet->count);
 
   if (should_len != len) {
-    printf("Wrong length: %i/%i", len, should_len);
+    WARNING("ntoh_mcast_packet(...) -> Wrong length: %i/%i\n", len, should_len);
     return 1;
   }
 
+  stats_ddhcp_received(packet->command);
+
   char str[INET_ADDRSTRLEN];
   inet_ntop(AF_INET, &(packet->prefix), str, INET_ADDRSTRLEN);
-  DEBUG("NODE: %lu PREFIX: %s/%i BLOCKSIZE: %i COMMAND: %i ALLOCATIONS: %i\n",
+  DEBUG("NODE: %lu PREFIX: %s/%i BLOCKSIZE: %i COMMAND: %i ALLOCATIONS: %u\n",
         (long unsigned int) packet->node_id,
         str,
         packet->prefix_len,
@@ -114,7 +169,7 @@ int ntoh_mcast_packet(uint8_t* buffer, int len, struct ddhcp_mcast_packet* packe
     packet->payload = (struct ddhcp_payload*) calloc(sizeof(struct ddhcp_payload), packet->count);
     payload = packet->payload;
 
-    for (int i = 0; i < packet->count; i++) {
+    for (unsigned int i = 0; i < packet->count; i++) {
       copy_buf_to_var_inc(buffer, uint32_t, tmp32);
       payload->block_index = ntohl(tmp32);
 
@@ -134,7 +189,7 @@ int ntoh_mcast_packet(uint8_t* buffer, int len, struct ddhcp_mcast_packet* packe
     packet->payload = (struct ddhcp_payload*) calloc(sizeof(struct ddhcp_payload), packet->count);
     payload = packet->payload;
 
-    for (int i = 0; i < packet->count; i++) {
+    for (unsigned int i = 0; i < packet->count; i++) {
       copy_buf_to_var_inc(buffer, uint32_t, tmp32);
       payload->block_index = ntohl(tmp32);
 
@@ -143,6 +198,95 @@ int ntoh_mcast_packet(uint8_t* buffer, int len, struct ddhcp_mcast_packet* packe
 
     break;
 
+  // Runs of blocks, they are expanded into a plain block list.
+  case DDHCP_MSG_UPDATECLAIM_RANGES:
+  case DDHCP_MSG_INQUIRE_RANGES:
+    do {
+      int claim = packet->command == DDHCP_MSG_UPDATECLAIM_RANGES;
+      int run_size = claim ? 8 : 6;
+      uint32_t total = 0;
+
+      for (unsigned int i = 0; i < packet->count; i++) {
+        memcpy(&tmp16, buffer + i * run_size + 4, sizeof(uint16_t));
+        total += ntohs(tmp16);
+      }
+
+      if (total > DDHCP_MAX_DECODED_COUNT) {
+        WARNING("ntoh_mcast_packet(...): Too many blocks in message (%u)\n", total);
+        return 1;
+      }
+
+      packet->payload = (struct ddhcp_payload*) calloc(sizeof(struct ddhcp_payload), total);
+      payload = packet->payload;
+
+      for (unsigned int i = 0; i < packet->count; i++) {
+        uint32_t start;
+        uint16_t length;
+        uint16_t timeout = 0;
+
+        copy_buf_to_var_inc(buffer, uint32_t, tmp32);
+        start = ntohl(tmp32);
+        copy_buf_to_var_inc(buffer, uint16_t, tmp16);
+        length = ntohs(tmp16);
+
+        if (claim) {
+          copy_buf_to_var_inc(buffer, uint16_t, tmp16);
+          timeout = ntohs(tmp16);
+        }
+
+        for (uint32_t j = 0; j < length; j++) {
+          payload->block_index = start + j;
+          payload->timeout = timeout;
+          payload++;
+        }
+      }
+
+      packet->command = claim ? DDHCP_MSG_UPDATECLAIM : DDHCP_MSG_INQUIRE;
+      packet->count = total;
+    } while (0);
+
+    break;
+
+  // Bitmap of blocks, bit i of byte j marks block base + 8 * j + i.
+  case DDHCP_MSG_UPDATECLAIM_BITMAP:
+  case DDHCP_MSG_INQUIRE_BITMAP:
+    do {
+      int claim = packet->command == DDHCP_MSG_UPDATECLAIM_BITMAP;
+      uint32_t base;
+      uint16_t timeout = 0;
+      uint32_t total = 0;
+
+      copy_buf_to_var_inc(buffer, uint32_t, tmp32);
+      base = ntohl(tmp32);
+
+      if (claim) {
+        copy_buf_to_var_inc(buffer, uint16_t, tmp16);
+        timeout = ntohs(tmp16);
+      }
+
+      for (unsigned int i = 0; i < packet->count; i++) {
+        total += __builtin_popcount(buffer[i]);
+      }
+
+      packet->payload = (struct ddhcp_payload*) calloc(sizeof(struct ddhcp_payload), total);
+      payload = packet->payload;
+
+      for (unsigned int i = 0; i < packet->count; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+          if (buffer[i] & (1 << bit)) {
+            payload->block_index = base + 8 * i + bit;
+            payload->timeout = timeout;
+            payload++;
+          }
+        }
+      }
+
+      packet->command = claim ? DDHCP_MSG_UPDATECLAIM : DDHCP_MSG_INQUIRE;
+      packet->count = total;
+    } while (0);
+
+    break;
+
   // ReNEWLease
   case DDHCP_MSG_RENEWLEASE:
   case DDHCP_MSG_LEASEACK:
@@ -163,14 +307,109 @@ int ntoh_mcast_packet(uint8_t* buffer, int len, struct ddhcp_mcast_packet* packe
     break;
   }
 
-  printf("\n");
-
   return 0;
 }
 
+static int _packet_payload_cmp(const void* a, const void* b) {
+  uint32_t index_a = ((const struct ddhcp_payload*) a)->block_index;
+  uint32_t index_b = ((const struct ddhcp_payload*) b)->block_index;
+
+  return (index_a > index_b) - (index_a < index_b);
+}
+
+/**
+ * Check whether entry i of a sorted block list continues the run of entry i - 1.
+ */
+static int _packet_run_continues(struct ddhcp_payload* payload, uint32_t i, uint32_t run_len, int claim) {
+  return payload[i].block_index == payload[i - 1].block_index + 1 &&
+         run_len < UINT16_MAX &&
+         (!claim || payload[i].timeout == payload[i - 1].timeout);
+}
+
+/**
+ * Replace the chosen encoding, iff the candidate needs fewer bytes per block.
+ */
+static void _packet_plan_pick(uint8_t* command, uint32_t* count, int* len, uint8_t c_command, uint32_t c_count, int c_len) {
+  if ((uint64_t) c_len * *count < (uint64_t) *len * c_count) {
+    *command = c_command;
+    *count = c_count;
+    *len = c_len;
+  }
+}
+
+/**
+ * Choose the encoding of the block list of packet, which carries the most
+ * blocks per byte in one datagram. Stores the command on the wire and the
+ * number of blocks to encode, returns the length of the datagram.
+ */
+static int _packet_plan(struct ddhcp_mcast_packet* packet, uint8_t* command, uint32_t* count) {
+  int claim = packet->command == DDHCP_MSG_UPDATECLAIM;
+  struct ddhcp_payload* payload = packet->payload;
+
+  *command = packet->command;
+  *count = packet->count;
+
+  if (*count > _packet_max_count(packet->command)) {
+    *count = _packet_max_count(packet->command);
+  }
+
+  int len = _packet_size(*command, *count);
+
+  if (!packet->compact || packet->count < 2) {
+    return len;
+  }
+
+  // Runs of consecutive blocks.
+  uint8_t ranges_command = claim ? DDHCP_MSG_UPDATECLAIM_RANGES : DDHCP_MSG_INQUIRE_RANGES;
+  uint32_t max_runs = _packet_max_count(ranges_command);
+  uint32_t runs = 1;
+  uint32_t run_len = 1;
+  uint32_t ranged = 1;
+
+  for (; ranged < packet->count && ranged < DDHCP_MAX_DECODED_COUNT; ranged++) {
+    if (_packet_run_continues(payload, ranged, run_len, claim)) {
+      run_len++;
+    } else if (runs < max_runs) {
+      runs++;
+      run_len = 1;
+    } else {
+      break;
+    }
+  }
+
+  _packet_plan_pick(command, count, &len, ranges_command, ranged, _packet_size(ranges_command, runs));
+
+  // Bitmap over the blocks following the first one.
+  uint8_t bitmap_command = claim ? DDHCP_MSG_UPDATECLAIM_BITMAP : DDHCP_MSG_INQUIRE_BITMAP;
+  uint32_t span = 8 * DDHCP_MAX_PAYLOAD_COUNT;
+  uint32_t mapped = 1;
+
+  while (mapped < packet->count &&
+         payload[mapped].block_index - payload[0].block_index < span &&
+         (!claim || payload[mapped].timeout == payload[0].timeout)) {
+    mapped++;
+  }
+
+  uint32_t bytes = (payload[mapped - 1].block_index - payload[0].block_index) / 8 + 1;
+  _packet_plan_pick(command, count, &len, bitmap_command, mapped, _packet_size(bitmap_command, bytes));
+
+  return len;
+}
+
 int hton_packet(struct ddhcp_mcast_packet* packet, char* buffer) {
 
   char* buffer_orig = buffer;
+  uint8_t command = packet->command;
+  uint8_t count = packet->count;
+
+  // Block lists may be split and encoded in a compact form,
+  // the number of encoded blocks is passed back in count.
+  if (command == DDHCP_MSG_UPDATECLAIM || command == DDHCP_MSG_INQUIRE) {
+    // The plan scans the whole block list, the count is cut afterwards.
+    uint32_t planned;
+    _packet_plan(packet, &command, &planned);
+    packet->count = planned;
+  }
 
   // Header
   copy_var_to_buf_inc(buffer, ddhcp_node_id, packet->node_id);
@@ -184,20 +423,21 @@ int hton_packet(struct ddhcp_mcast_packet* packet, char* buffer) {
   // size of a block
   copy_var_to_buf_inc(buffer, uint8_t, packet->blocksize);
   // the command
-  copy_var_to_buf_inc(buffer, uint8_t, packet->command);
-  // count of payload entries
-  copy_var_to_buf_inc(buffer, uint8_t, packet->count);
+  copy_var_to_buf_inc(buffer, uint8_t, command);
+  // count of payload entries, filled in below
+  copy_var_to_buf_inc(buffer, uint8_t, count);
 
   uint8_t tmp8;
   uint16_t tmp16;
   uint32_t tmp32;
-  struct ddhcp_payload* payload;
+  struct ddhcp_payload* payload = packet->payload;
+  uint32_t index = 0;
 
-  switch (packet->command) {
+  switch (command) {
   case DDHCP_MSG_UPDATECLAIM:
-    payload = packet->payload;
+    count = packet->count;
 
-    for (unsigned int index = 0; index < packet->count; index++) {
+    for (index = 0; index < packet->count; index++) {
       tmp32 = htonl(payload->block_index);
       copy_var_to_buf_inc(buffer, uint32_t, tmp32);
 
@@ -213,9 +453,9 @@ int hton_packet(struct ddhcp_mcast_packet* packet, char* buffer) {
     break;
 
   case DDHCP_MSG_INQUIRE:
-    payload = packet->payload;
+    count = packet->count;
 
-    for (unsigned int index = 0; index < packet->count; index++) {
+    for (index = 0; index < packet->count; index++) {
       tmp32 = htonl(payload->block_index);
       copy_var_to_buf_inc(buffer, uint32_t, tmp32);
 
@@ -224,6 +464,55 @@ int hton_packet(struct ddhcp_mcast_packet* packet, char* buffer) {
 
     break;
 
+  case DDHCP_MSG_UPDATECLAIM_RANGES:
+  case DDHCP_MSG_INQUIRE_RANGES:
+    count = 0;
+
+    while (index < packet->count) {
+      uint32_t run_len = 1;
+
+      while (index + run_len < packet->count && _packet_run_continues(payload, index + run_len, run_len, command == DDHCP_MSG_UPDATECLAIM_RANGES)) {
+        run_len++;
+      }
+
+      tmp32 = htonl(payload[index].block_index);
+      copy_var_to_buf_inc(buffer, uint32_t, tmp32);
+
+      tmp16 = htons(run_len);
+      copy_var_to_buf_inc(buffer, uint16_t, tmp16);
+
+      if (command == DDHCP_MSG_UPDATECLAIM_RANGES) {
+        tmp16 = htons(payload[index].timeout);
+        copy_var_to_buf_inc(buffer, uint16_t, tmp16);
+      }
+
+      index += run_len;
+      count++;
+    }
+
+    break;
+
+  case DDHCP_MSG_UPDATECLAIM_BITMAP:
+  case DDHCP_MSG_INQUIRE_BITMAP:
+    tmp32 = htonl(payload[0].block_index);
+    copy_var_to_buf_inc(buffer, uint32_t, tmp32);
+
+    if (command == DDHCP_MSG_UPDATECLAIM_BITMAP) {
+      tmp16 = htons(payload[0].timeout);
+      copy_var_to_buf_inc(buffer, uint16_t, tmp16);
+    }
+
+    count = (payload[packet->count - 1].block_index - payload[0].block_index) / 8 + 1;
+    memset(buffer, 0, count);
+
+    for (index = 0; index < packet->count; index++) {
+      uint32_t offset = payload[index].block_index - payload[0].block_index;
+      buffer[offset / 8] |= 1 << (offset % 8);
+    }
+
+    buffer += count;
+    break;
+
   case DDHCP_MSG_LEASEACK:
   case DDHCP_MSG_LEASENAK:
   case DDHCP_MSG_RELEASE:
@@ -235,29 +524,21 @@ int hton_packet(struct ddhcp_mcast_packet* packet, char* buffer) {
     tmp32 = htonl(packet->renew_payload->lease_seconds);
     copy_var_to_buf_inc(buffer, uint32_t, tmp32);
     memcpy(buffer, &packet->renew_payload->chaddr, 16);
+    buffer += 16;
 
   default:
 
     break;
   }
 
-  buffer = buffer_orig;
+  buffer_orig[15] = count;
+  stats_ddhcp_sent(command);
 
-  return 0;
+  return buffer - buffer_orig;
 }
 
-int send_packet_mcast(struct ddhcp_mcast_packet* packet, int mulitcast_socket, uint32_t scope_id) {
-  int len = _packet_size(packet->command, packet->count);
-
-  char* buffer = (char*) calloc(1, len);
-
-  if (!buffer) {
-    return 1;
-  }
-
-  errno = 0;
-
-  hton_packet(packet, buffer);
+int send_packet_mcast(struct ddhcp_mcast_packet* packet, int mulitcast_socket, uint32_t scope_id, txqueue* queue) {
+  DEBUG("send_packet_mcast(packet,%i)\n", mulitcast_socket);
 
   struct sockaddr_in6 dest_addr = {
     .sin6_family = AF_INET6,
@@ -279,23 +560,35 @@ int send_packet_mcast(struct ddhcp_mcast_packet* packet, int mulitcast_socket, u
 
   memcpy(&dest_addr.sin6_addr, &dest, sizeof(dest));
 
-  sendto(mulitcast_socket, buffer, len, 0, (struct sockaddr*) &dest_addr, sizeof(dest_addr));
+  if (packet->compact && (packet->command == DDHCP_MSG_UPDATECLAIM || packet->command == DDHCP_MSG_INQUIRE)) {
+    qsort(packet->payload, packet->count, sizeof(struct ddhcp_payload), _packet_payload_cmp);
+  }
+
+  // Split the payload into as many datagrams as needed,
+  // hton_packet encodes as many blocks as fit into one.
+  struct ddhcp_mcast_packet part = *packet;
+  uint32_t sent = 0;
+
+  do {
+    part.count = packet->count - sent;
+    part.payload = packet->payload + sent;
+
+    char* buffer = (char*) txqueue_buffer(queue);
+    int len = hton_packet(&part, buffer);
+
+    txqueue_push(queue, mulitcast_socket, len, (struct sockaddr*) &dest_addr, sizeof(dest_addr));
 
-  free(buffer);
+    sent += part.count;
+  } while (sent < packet->count);
+
+  DEBUG("send_packet_mcast( ... ) -> %u entries sent\n", sent);
 
   return 0;
 }
 
-int send_packet_direct(struct ddhcp_mcast_packet* packet, struct in6_addr* dest, int multicast_socket, uint32_t scope_id) {
+int send_packet_direct(struct ddhcp_mcast_packet* packet, struct in6_addr* dest, int multicast_socket, uint32_t scope_id, txqueue* queue) {
   DEBUG("send_packet_direct(packet,%i)\n", multicast_socket);
-  int len = _packet_size(packet->command, packet->count);
-
-  char* buffer = (char*) calloc(1, len);
-
-  if (!buffer) {
-    ERROR("send_packet_direct( ... ) -> Failure\n");
-    return 1;
-  }
+  char* buffer = (char*) txqueue_buffer(queue);
 
   struct sockaddr_in6 dest_addr = {
     .sin6_family = AF_INET6,
@@ -310,14 +603,9 @@ int send_packet_direct(struct ddhcp_mcast_packet* packet, struct in6_addr* dest,
   DEBUG("Send message to %s\n",
         inet_ntop(AF_INET6, dest, ipv6_sender, INET6_ADDRSTRLEN));
 
-  hton_packet(packet, buffer);
-
-  // TODO Error handling
-  int ret = sendto(multicast_socket, buffer, len, 0, (struct sockaddr*) &dest_addr, sizeof(struct sockaddr_in6));
-
-  printf("%i\n", ret);
+  int len = hton_packet(packet, buffer);
 
-  free(buffer);
+  txqueue_push(queue, multicast_socket, len, (struct sockaddr*) &dest_addr, sizeof(struct sockaddr_in6));
 
   return 0;
 }
@@ -24,11 +24,26 @@
 
 #define DDHCP_MSG_UPDATECLAIM 1
 #define DDHCP_MSG_INQUIRE 2
+// Compact encodings of the block lists, as runs of consecutive blocks
+// or as a bitmap over the blocks following a base block.
+#define DDHCP_MSG_UPDATECLAIM_RANGES 3
+#define DDHCP_MSG_INQUIRE_RANGES 4
+#define DDHCP_MSG_UPDATECLAIM_BITMAP 5
+#define DDHCP_MSG_INQUIRE_BITMAP 6
 #define DDHCP_MSG_RENEWLEASE 16
 #define DDHCP_MSG_LEASEACK 17
 #define DDHCP_MSG_LEASENAK 18
 #define DDHCP_MSG_RELEASE 19
 
+// Largest ddhcp datagram we send, the minimum IPv6 MTU minus the IPv6 and
+// UDP headers, so announcements are never fragmented.
+#define DDHCP_MAX_DATAGRAM_SIZE 1232
+
+// Largest number of payload entries in one datagram, the count on the wire is a single byte.
+#define DDHCP_MAX_PAYLOAD_COUNT 255
+
+// Largest number of blocks a compact encoded datagram may carry.
+#define DDHCP_MAX_DECODED_COUNT 65535
 
 struct ddhcp_mcast_packet {
   ddhcp_node_id node_id;
@@ -36,7 +51,11 @@ struct ddhcp_mcast_packet {
   uint8_t prefix_len;
   uint8_t blocksize;
   uint8_t command;
-  uint8_t count;
+  // Number of payload entries, messages with more entries than fit into
+  // one datagram are split by send_packet_mcast.
+  uint32_t count;
+  // Allow the compact encodings for block lists, older nodes only know the plain one.
+  uint8_t compact;
 
   struct sockaddr_in6* sender;
 
@@ -66,7 +85,11 @@ typedef struct ddhcp_renew_payload ddhcp_renew_payload;
 struct ddhcp_mcast_packet* new_ddhcp_packet(int command, ddhcp_config* config);
 int ntoh_mcast_packet(uint8_t* buffer, int len, struct ddhcp_mcast_packet* packet);
 
-int send_packet_mcast(struct ddhcp_mcast_packet* packet, int mulitcast_socket, uint32_t scope_id);
-int send_packet_direct(struct ddhcp_mcast_packet* packet, struct in6_addr* dest, int multicast_socket, uint32_t scope_id);
+/**
+ * Encode a packet into the transmit queue, it is sent when the queue is flushed.
+ * Block lists are sorted by block index, when a compact encoding is allowed.
+ */
+int send_packet_mcast(struct ddhcp_mcast_packet* packet, int mulitcast_socket, uint32_t scope_id, txqueue* queue);
+int send_packet_direct(struct ddhcp_mcast_packet* packet, struct in6_addr* dest, int multicast_socket, uint32_t scope_id, txqueue* queue);
 
 #endif
@@ -0,0 +1,77 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "scheduler.h"
+
+int scheduler_init(scheduler* sched) {
+  memset(sched->deadlines, 0, sizeof(sched->deadlines));
+  sched->armed = 0;
+  sched->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (sched->fd < 0) {
+    ERROR("scheduler_init(...) -> Unable to create timerfd: %s\n", strerror(errno));
+    return 1;
+  }
+
+  return 0;
+}
+
+void scheduler_free(scheduler* sched) {
+  if (sched->fd >= 0) {
+    close(sched->fd);
+  }
+
+  sched->fd = -1;
+}
+
+void scheduler_set(scheduler* sched, enum scheduler_task task, time_t deadline) {
+  sched->deadlines[task] = deadline;
+}
+
+int scheduler_due(scheduler* sched, enum scheduler_task task, time_t now) {
+  if (sched->deadlines[task] == 0 || sched->deadlines[task] > now) {
+    return 0;
+  }
+
+  sched->deadlines[task] = 0;
+  return 1;
+}
+
+void scheduler_arm(scheduler* sched) {
+  time_t earliest = 0;
+
+  for (int task = 0; task < SCHEDULE_TASKS; task++) {
+    if (sched->deadlines[task] != 0 && (earliest == 0 || sched->deadlines[task] < earliest)) {
+      earliest = sched->deadlines[task];
+    }
+  }
+
+  if (earliest == sched->armed) {
+    return;
+  }
+
+  // A zero value disarms the timer, deadlines in the past expire at once.
+  struct itimerspec spec = { { 0, 0 }, { earliest, 0 } };
+
+  if (timerfd_settime(sched->fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+    ERROR("scheduler_arm(...) -> Unable to arm timerfd: %s\n", strerror(errno));
+    return;
+  }
+
+  DEBUG("scheduler_arm(...) -> next wake up at %li\n", (long) earliest);
+  sched->armed = earliest;
+}
+
+void scheduler_ack(scheduler* sched) {
+  uint64_t expirations;
+
+  if (read(sched->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+    ERROR("scheduler_ack(...) -> Unable to read timerfd: %s\n", strerror(errno));
+  }
+
+  // The timer has to be armed again for the next deadline.
+  sched->armed = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * The house keeping tasks, each one with its own deadline.
+ */
+enum scheduler_task {
+  // Expire blocks and leases.
+  SCHEDULE_EXPIRY,
+  // Inquire free blocks and own the blocks claimed often enough.
+  SCHEDULE_CLAIM_ROUND,
+  // Refresh the claims for our blocks.
+  SCHEDULE_CLAIM_REFRESH,
+  // Drop expired packets from the dhcp packet cache.
+  SCHEDULE_CACHE_EXPIRY,
+  SCHEDULE_TASKS
+};
+
+/**
+ * Deadlines of the house keeping tasks and a timerfd armed for the
+ * earliest one, so the event loop only wakes up when a task is due.
+ * Deadlines are given on the monotonic clock of clock.h.
+ * A deadline of 0 means the task is not scheduled.
+ */
+struct scheduler {
+  int fd;
+  time_t deadlines[SCHEDULE_TASKS];
+  // Deadline the timerfd is armed for, 0 iff it is disarmed.
+  time_t armed;
+};
+typedef struct scheduler scheduler;
+
+/**
+ * Create the timerfd of the scheduler, no task is scheduled.
+ * Returns a value greater 0 on failure.
+ */
+int scheduler_init(scheduler* sched);
+void scheduler_free(scheduler* sched);
+
+/**
+ * Set the deadline of task, 0 unschedules it.
+ */
+void scheduler_set(scheduler* sched, enum scheduler_task task, time_t deadline);
+
+/**
+ * Check whether task is scheduled.
+ */
+#define scheduler_pending(sched, task) ((sched)->deadlines[task] != 0)
+
+/**
+ * Check whether task is due at now. A due task is unscheduled,
+ * it has to be scheduled again by the caller.
+ */
+int scheduler_due(scheduler* sched, enum scheduler_task task, time_t now);
+
+/**
+ * Arm the timerfd for the earliest deadline.
+ */
+void scheduler_arm(scheduler* sched);
+
+/**
+ * Consume the expirations of the timerfd, after it became readable.
+ */
+void scheduler_ack(scheduler* sched);
+
+#endif
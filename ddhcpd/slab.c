@@ -0,0 +1,90 @@
+#include <stdlib.h>
+
+#include "logger.h"
+#include "slab.h"
+
+// Chunks start with a header that keeps the objects 8 byte aligned.
+union slab_chunk {
+  void* next;
+  uint64_t align;
+};
+
+static int _slab_grow(slab* pool) {
+  union slab_chunk* chunk = (union slab_chunk*) malloc(sizeof(union slab_chunk) + pool->object_size * pool->objects_per_chunk);
+
+  if (!chunk) {
+    ERROR("_slab_grow(...) -> Unable to allocate memory\n");
+    return 1;
+  }
+
+  chunk->next = pool->chunks;
+  pool->chunks = chunk;
+
+  uint8_t* object = (uint8_t*)(chunk + 1);
+
+  for (uint32_t i = 0; i < pool->objects_per_chunk; i++) {
+    *(void**) object = pool->free_list;
+    pool->free_list = object;
+    object += pool->object_size;
+  }
+
+  pool->capacity += pool->objects_per_chunk;
+  DEBUG("_slab_grow(...) -> capacity %u\n", pool->capacity);
+
+  return 0;
+}
+
+int slab_init(slab* pool, size_t object_size, uint32_t objects_per_chunk) {
+  DEBUG("slab_init(pool, %zu, %u)\n", object_size, objects_per_chunk);
+  // Objects have to hold the free list pointer and keep the alignment.
+  if (object_size < sizeof(void*)) {
+    object_size = sizeof(void*);
+  }
+
+  pool->object_size = (object_size + 7) & ~((size_t) 7);
+  pool->objects_per_chunk = objects_per_chunk > 0 ? objects_per_chunk : 1;
+  pool->free_list = NULL;
+  pool->chunks = NULL;
+  pool->capacity = 0;
+  pool->in_use = 0;
+  pool->high_water = 0;
+
+  return _slab_grow(pool);
+}
+
+void slab_free(slab* pool) {
+  union slab_chunk* chunk = pool->chunks;
+
+  while (chunk) {
+    union slab_chunk* next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+
+  pool->free_list = NULL;
+  pool->chunks = NULL;
+  pool->capacity = 0;
+  pool->in_use = 0;
+}
+
+void* slab_alloc(slab* pool) {
+  if (!pool->free_list && _slab_grow(pool)) {
+    return NULL;
+  }
+
+  void* object = pool->free_list;
+  pool->free_list = *(void**) object;
+  pool->in_use++;
+
+  if (pool->in_use > pool->high_water) {
+    pool->high_water = pool->in_use;
+  }
+
+  return object;
+}
+
+void slab_release(slab* pool, void* object) {
+  *(void**) object = pool->free_list;
+  pool->free_list = object;
+  pool->in_use--;
+}
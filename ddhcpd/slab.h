@@ -0,0 +1,47 @@
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A pool of fixed-size objects. Objects are carved out of chunks which
+ * are allocated up front, released objects are kept on a free list and
+ * handed out again, so the heap is only touched when the pool grows
+ * beyond its previous high-water mark.
+ */
+struct slab {
+  size_t object_size;
+  uint32_t objects_per_chunk;
+  // Singly linked lists threaded through the unused objects and chunks.
+  void* free_list;
+  void* chunks;
+  uint32_t capacity;
+  uint32_t in_use;
+  uint32_t high_water;
+};
+typedef struct slab slab;
+
+/**
+ * Prepare a pool of objects with object_size bytes and allocate the first
+ * chunk of objects_per_chunk objects. Returns a value greater 0 on failure.
+ */
+int slab_init(slab* pool, size_t object_size, uint32_t objects_per_chunk);
+
+/**
+ * Release all chunks of the pool, objects in use become invalid.
+ */
+void slab_free(slab* pool);
+
+/**
+ * Take an object from the pool, the pool grows by a chunk when it is
+ * exhausted. The content of the object is undefined. Returns NULL on failure.
+ */
+void* slab_alloc(slab* pool);
+
+/**
+ * Return an object into the pool.
+ */
+void slab_release(slab* pool, void* object);
+
+#endif
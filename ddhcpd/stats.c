@@ -0,0 +1,64 @@
+#include <stdio.h>
+
+#include "stats.h"
+
+ddhcp_stats stats;
+
+const char* stats_dhcp_type_names[STATS_DHCP_TYPES] = {
+  "unknown", "discover", "offer", "request", "decline", "ack", "nak", "release", "inform"
+};
+
+const char* stats_ddhcp_command_names[STATS_DDHCP_COMMANDS] = {
+  [0] = "unknown",
+  [1] = "updateclaim",
+  [2] = "inquire",
+  [3] = "updateclaim_ranges",
+  [4] = "inquire_ranges",
+  [5] = "updateclaim_bitmap",
+  [6] = "inquire_bitmap",
+  [16] = "renewlease",
+  [17] = "leaseack",
+  [18] = "leasenak",
+  [19] = "release",
+};
+
+void stats_show(int fd) {
+  dprintf(fd, "counter,value\n");
+
+  for (int i = 0; i < STATS_DHCP_TYPES; i++) {
+    dprintf(fd, "dhcp_received_%s,%lu\n", stats_dhcp_type_names[i], (unsigned long) stats.dhcp_received[i]);
+  }
+
+  for (int i = 0; i < STATS_DHCP_TYPES; i++) {
+    dprintf(fd, "dhcp_sent_%s,%lu\n", stats_dhcp_type_names[i], (unsigned long) stats.dhcp_sent[i]);
+  }
+
+  dprintf(fd, "dhcp_parse_errors_other,%lu\n", (unsigned long) stats.dhcp_parse_errors[0]);
+
+  for (int i = 1; i < STATS_DHCP_ERRORS; i++) {
+    dprintf(fd, "dhcp_parse_errors_%i,%lu\n", -i, (unsigned long) stats.dhcp_parse_errors[i]);
+  }
+
+  for (int i = 0; i < STATS_DDHCP_COMMANDS; i++) {
+    if (stats_ddhcp_command_names[i]) {
+      dprintf(fd, "ddhcp_received_%s,%lu\n", stats_ddhcp_command_names[i], (unsigned long) stats.ddhcp_received[i]);
+    } else if (stats.ddhcp_received[i]) {
+      dprintf(fd, "ddhcp_received_command_%i,%lu\n", i, (unsigned long) stats.ddhcp_received[i]);
+    }
+  }
+
+  for (int i = 0; i < STATS_DDHCP_COMMANDS; i++) {
+    if (stats_ddhcp_command_names[i]) {
+      dprintf(fd, "ddhcp_sent_%s,%lu\n", stats_ddhcp_command_names[i], (unsigned long) stats.ddhcp_sent[i]);
+    } else if (stats.ddhcp_sent[i]) {
+      dprintf(fd, "ddhcp_sent_command_%i,%lu\n", i, (unsigned long) stats.ddhcp_sent[i]);
+    }
+  }
+
+  dprintf(fd, "ddhcp_parse_errors,%lu\n", (unsigned long) stats.ddhcp_parse_errors);
+  dprintf(fd, "claim_rounds,%lu\n", (unsigned long) stats.claim_rounds);
+  dprintf(fd, "claims_won,%lu\n", (unsigned long) stats.claims_won);
+  dprintf(fd, "claims_lost,%lu\n", (unsigned long) stats.claims_lost);
+  dprintf(fd, "cache_hits,%lu\n", (unsigned long) stats.cache_hits);
+  dprintf(fd, "cache_misses,%lu\n", (unsigned long) stats.cache_misses);
+}
@@ -0,0 +1,72 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+// DHCP message types 1 to 8, slot 0 counts unknown types.
+#define STATS_DHCP_TYPES 9
+
+// Error codes -1 to -7 of ntoh_dhcp_packet, slot 0 counts other codes.
+#define STATS_DHCP_ERRORS 8
+
+// DDHCP commands 1 to 19, slot 0 counts unknown commands.
+#define STATS_DDHCP_COMMANDS 20
+
+/**
+ * Counters of the messages handled by the daemon. They are plain counters,
+ * the daemon is single threaded, and never reset while it runs.
+ */
+struct ddhcp_stats {
+  uint64_t dhcp_received[STATS_DHCP_TYPES];
+  uint64_t dhcp_sent[STATS_DHCP_TYPES];
+  uint64_t dhcp_parse_errors[STATS_DHCP_ERRORS];
+
+  // DDHCP datagrams by the command on the wire.
+  uint64_t ddhcp_received[STATS_DDHCP_COMMANDS];
+  uint64_t ddhcp_sent[STATS_DDHCP_COMMANDS];
+  uint64_t ddhcp_parse_errors;
+
+  // Claim rounds run, blocks we finished claiming
+  // and blocks another node claimed first.
+  uint64_t claim_rounds;
+  uint64_t claims_won;
+  uint64_t claims_lost;
+
+  // Lookups in the dhcp packet cache.
+  uint64_t cache_hits;
+  uint64_t cache_misses;
+};
+typedef struct ddhcp_stats ddhcp_stats;
+
+extern ddhcp_stats stats;
+
+// Names of the message types and commands, NULL for unknown commands.
+extern const char* stats_dhcp_type_names[STATS_DHCP_TYPES];
+extern const char* stats_ddhcp_command_names[STATS_DDHCP_COMMANDS];
+
+static inline void stats_dhcp_received(int type) {
+  stats.dhcp_received[type > 0 && type < STATS_DHCP_TYPES ? type : 0]++;
+}
+
+static inline void stats_dhcp_sent(int type) {
+  stats.dhcp_sent[type > 0 && type < STATS_DHCP_TYPES ? type : 0]++;
+}
+
+static inline void stats_dhcp_parse_error(int error) {
+  stats.dhcp_parse_errors[error < 0 && -error < STATS_DHCP_ERRORS ? -error : 0]++;
+}
+
+static inline void stats_ddhcp_received(int command) {
+  stats.ddhcp_received[command > 0 && command < STATS_DDHCP_COMMANDS ? command : 0]++;
+}
+
+static inline void stats_ddhcp_sent(int command) {
+  stats.ddhcp_sent[command > 0 && command < STATS_DDHCP_COMMANDS ? command : 0]++;
+}
+
+/**
+ * Write all counters as name,value lines to fd.
+ */
+void stats_show(int fd);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+
+#include "logger.h"
+#include "timer.h"
+
+static void _timer_heap_place(timer_heap* heap, uint32_t index, timer_node* node) {
+  heap->nodes[index] = node;
+  node->pos = index + 1;
+}
+
+static void _timer_heap_sift_up(timer_heap* heap, uint32_t index) {
+  timer_node* node = heap->nodes[index];
+
+  while (index > 0) {
+    uint32_t parent = (index - 1) / 2;
+
+    if (heap->nodes[parent]->deadline <= node->deadline) {
+      break;
+    }
+
+    _timer_heap_place(heap, index, heap->nodes[parent]);
+    index = parent;
+  }
+
+  _timer_heap_place(heap, index, node);
+}
+
+static void _timer_heap_sift_down(timer_heap* heap, uint32_t index) {
+  timer_node* node = heap->nodes[index];
+
+  for (;;) {
+    uint32_t child = 2 * index + 1;
+
+    if (child >= heap->size) {
+      break;
+    }
+
+    if (child + 1 < heap->size && heap->nodes[child + 1]->deadline < heap->nodes[child]->deadline) {
+      child++;
+    }
+
+    if (node->deadline <= heap->nodes[child]->deadline) {
+      break;
+    }
+
+    _timer_heap_place(heap, index, heap->nodes[child]);
+    index = child;
+  }
+
+  _timer_heap_place(heap, index, node);
+}
+
+void timer_heap_init(timer_heap* heap) {
+  heap->nodes = NULL;
+  heap->size = 0;
+  heap->capacity = 0;
+}
+
+void timer_heap_free(timer_heap* heap) {
+  for (uint32_t i = 0; i < heap->size; i++) {
+    heap->nodes[i]->pos = 0;
+  }
+
+  free(heap->nodes);
+  timer_heap_init(heap);
+}
+
+int timer_schedule(timer_heap* heap, timer_node* node, time_t deadline) {
+  if (timer_is_scheduled(node)) {
+    time_t previous = node->deadline;
+    node->deadline = deadline;
+
+    if (deadline < previous) {
+      _timer_heap_sift_up(heap, node->pos - 1);
+    } else {
+      _timer_heap_sift_down(heap, node->pos - 1);
+    }
+
+    return 0;
+  }
+
+  if (heap->size == heap->capacity) {
+    uint32_t capacity = heap->capacity ? heap->capacity * 2 : 16;
+    timer_node** nodes = (timer_node**) realloc(heap->nodes, sizeof(timer_node*) * capacity);
+
+    if (!nodes) {
+      ERROR("timer_schedule(...) -> Unable to allocate memory\n");
+      return 1;
+    }
+
+    heap->nodes = nodes;
+    heap->capacity = capacity;
+  }
+
+  node->deadline = deadline;
+  heap->nodes[heap->size] = node;
+  heap->size++;
+  _timer_heap_sift_up(heap, heap->size - 1);
+
+  return 0;
+}
+
+void timer_cancel(timer_heap* heap, timer_node* node) {
+  if (!timer_is_scheduled(node)) {
+    return;
+  }
+
+  uint32_t index = node->pos - 1;
+  node->pos = 0;
+  heap->size--;
+
+  if (index == heap->size) {
+    return;
+  }
+
+  // Fill the gap with the last node and restore the heap property.
+  timer_node* last = heap->nodes[heap->size];
+  _timer_heap_place(heap, index, last);
+
+  if (index > 0 && last->deadline < heap->nodes[(index - 1) / 2]->deadline) {
+    _timer_heap_sift_up(heap, index);
+  } else {
+    _timer_heap_sift_down(heap, index);
+  }
+}
+
+timer_node* timer_peek(timer_heap* heap) {
+  return heap->size > 0 ? heap->nodes[0] : NULL;
+}
+
+timer_node* timer_pop_expired(timer_heap* heap, time_t now) {
+  timer_node* node = timer_peek(heap);
+
+  if (!node || node->deadline >= now) {
+    return NULL;
+  }
+
+  timer_cancel(heap, node);
+  return node;
+}
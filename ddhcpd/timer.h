@@ -0,0 +1,56 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * A binary min-heap of deadlines. Nodes are embedded into the structures
+ * which carry a deadline and can be mapped back via container_of.
+ */
+struct timer_node {
+  time_t deadline;
+  // Position in the heap plus one, zero iff the node is not scheduled.
+  uint32_t pos;
+};
+typedef struct timer_node timer_node;
+
+struct timer_heap {
+  timer_node** nodes;
+  uint32_t size;
+  uint32_t capacity;
+};
+typedef struct timer_heap timer_heap;
+
+#define timer_is_scheduled(node) ((node)->pos != 0)
+
+void timer_heap_init(timer_heap* heap);
+
+/**
+ * Release the memory of the heap, nodes are left untouched.
+ */
+void timer_heap_free(timer_heap* heap);
+
+/**
+ * Insert node with the given deadline or move it, when it is already
+ * scheduled. Returns a value greater 0 on failure.
+ */
+int timer_schedule(timer_heap* heap, timer_node* node, time_t deadline);
+
+/**
+ * Remove node from the heap, unscheduled nodes are ignored.
+ */
+void timer_cancel(timer_heap* heap, timer_node* node);
+
+/**
+ * Return the node with the earliest deadline or NULL.
+ */
+timer_node* timer_peek(timer_heap* heap);
+
+/**
+ * Remove and return the node with the earliest deadline, iff its
+ * deadline is before now. Otherwise NULL is returned.
+ */
+timer_node* timer_pop_expired(timer_heap* heap, time_t now);
+
+#endif
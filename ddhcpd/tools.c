@@ -77,3 +77,11 @@ char* hwaddr2c(uint8_t* hwaddr) {
   str[32] = '\0';
   return str;
 }
+
+uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+
+  return hash;
+}
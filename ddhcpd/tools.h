@@ -12,4 +12,12 @@ void addr_add(struct in_addr* subnet, struct in_addr* result, int add);
 dhcp_option* parse_option();
 char* hwaddr2c(uint8_t* hwaddr);
 
+// Initial value of a FNV-1a hash.
+#define FNV1A_INIT 2166136261u
+
+/**
+ * Continue the FNV-1a hash over len bytes of data, starting from hash.
+ */
+uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t len);
+
 #endif
@@ -0,0 +1,116 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+#include "txqueue.h"
+
+int txqueue_init(txqueue* queue) {
+  queue->buffers = (uint8_t*) malloc(TXQUEUE_SIZE * TXQUEUE_BUFFER_SIZE);
+  queue->count = 0;
+
+  if (!queue->buffers) {
+    ERROR("txqueue_init(...) -> Unable to allocate memory\n");
+    return 1;
+  }
+
+  memset(queue->msgs, 0, sizeof(queue->msgs));
+
+  for (int i = 0; i < TXQUEUE_SIZE; i++) {
+    queue->iovecs[i].iov_base = queue->buffers + i * TXQUEUE_BUFFER_SIZE;
+    queue->msgs[i].msg_hdr.msg_iov = &queue->iovecs[i];
+    queue->msgs[i].msg_hdr.msg_iovlen = 1;
+    queue->msgs[i].msg_hdr.msg_name = &queue->dests[i];
+  }
+
+  return 0;
+}
+
+void txqueue_free(txqueue* queue) {
+  free(queue->buffers);
+  queue->buffers = NULL;
+  queue->count = 0;
+}
+
+uint8_t* txqueue_buffer(txqueue* queue) {
+  if (queue->count == TXQUEUE_SIZE) {
+    txqueue_flush(queue);
+  }
+
+  return queue->buffers + queue->count * TXQUEUE_BUFFER_SIZE;
+}
+
+void txqueue_push(txqueue* queue, int socket, uint16_t len, struct sockaddr* dest, socklen_t dest_len) {
+  uint32_t i = queue->count;
+
+  queue->iovecs[i].iov_len = len;
+  memcpy(&queue->dests[i], dest, dest_len);
+  queue->msgs[i].msg_hdr.msg_namelen = dest_len;
+  queue->sockets[i] = socket;
+  queue->intervals[i] = LATENCY_NONE;
+  queue->count++;
+}
+
+void txqueue_stamp(txqueue* queue, int interval, const struct timespec* received) {
+  if (queue->count == 0) {
+    return;
+  }
+
+  queue->intervals[queue->count - 1] = interval;
+  queue->received[queue->count - 1] = *received;
+}
+
+static void _txqueue_record(txqueue* queue, uint32_t start, uint32_t end) {
+  struct timespec sent = { 0 };
+
+  for (uint32_t i = start; i < end; i++) {
+    if (queue->intervals[i] == LATENCY_NONE) {
+      continue;
+    }
+
+    // Receive timestamps of the kernel are taken from the wall clock.
+    if (sent.tv_sec == 0) {
+      clock_gettime(CLOCK_REALTIME, &sent);
+    }
+
+    latency_record(queue->intervals[i], &queue->received[i], &sent);
+  }
+}
+
+void txqueue_flush(txqueue* queue) {
+  uint32_t start = 0;
+
+  if (queue->count > 0) {
+    DEBUG("txqueue_flush(queue) -> %u datagrams\n", queue->count);
+  }
+
+  while (start < queue->count) {
+    // Send runs of datagrams for the same socket together.
+    uint32_t end = start + 1;
+
+    while (end < queue->count && queue->sockets[end] == queue->sockets[start]) {
+      end++;
+    }
+
+    while (start < end) {
+      int ret = sendmmsg(queue->sockets[start], queue->msgs + start, end - start, 0);
+
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        ERROR("txqueue_flush(...) -> sendmmsg failed: %s\n", strerror(errno));
+        // Drop the datagram which failed.
+        queue->intervals[start] = LATENCY_NONE;
+        ret = 1;
+      }
+
+      _txqueue_record(queue, start, start + ret);
+      start += ret;
+    }
+  }
+
+  queue->count = 0;
+}
@@ -0,0 +1,64 @@
+#ifndef _TXQUEUE_H
+#define _TXQUEUE_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "latency.h"
+
+// Number of datagrams queued, before the queue is flushed.
+#define TXQUEUE_SIZE 64
+
+// Size of a queued datagram, large enough for every message we send.
+#define TXQUEUE_BUFFER_SIZE 2048
+
+/**
+ * A queue of outgoing datagrams. Messages are encoded in place into the
+ * buffers of the queue and sent with one sendmmsg call per socket, when
+ * the queue is flushed at the end of an event loop round.
+ */
+struct txqueue {
+  uint8_t* buffers;
+  struct mmsghdr msgs[TXQUEUE_SIZE];
+  struct iovec iovecs[TXQUEUE_SIZE];
+  struct sockaddr_in6 dests[TXQUEUE_SIZE];
+  int sockets[TXQUEUE_SIZE];
+  // Latency interval a datagram ends and the receive time of its request.
+  int8_t intervals[TXQUEUE_SIZE];
+  struct timespec received[TXQUEUE_SIZE];
+  uint32_t count;
+};
+typedef struct txqueue txqueue;
+
+/**
+ * Allocate the buffers of the queue. Returns a value greater 0 on failure.
+ */
+int txqueue_init(txqueue* queue);
+void txqueue_free(txqueue* queue);
+
+/**
+ * Return the buffer for the next datagram, of TXQUEUE_BUFFER_SIZE bytes.
+ * The queue is flushed first, when it is full.
+ */
+uint8_t* txqueue_buffer(txqueue* queue);
+
+/**
+ * Queue the first len bytes of the buffer returned by txqueue_buffer
+ * to be sent on socket to dest.
+ */
+void txqueue_push(txqueue* queue, int socket, uint16_t len, struct sockaddr* dest, socklen_t dest_len);
+
+/**
+ * Record the latency of the datagram queued last, from received to the
+ * time it is sent, in the histogram of interval.
+ */
+void txqueue_stamp(txqueue* queue, int interval, const struct timespec* received);
+
+/**
+ * Send all queued datagrams.
+ */
+void txqueue_flush(txqueue* queue);
+
+#endif
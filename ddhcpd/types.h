@@ -4,8 +4,14 @@
 #include <arpa/inet.h>
 #include <time.h>
 
+#include "freemap.h"
+#include "lease_index.h"
+#include "slab.h"
 #include "list.h"
 #include "dhcp_packet.h"
+#include "timer.h"
+#include "txqueue.h"
+#include "dhcp_cache.h"
 
 #define NODE_ID_CMP(id1,id2) memcmp((char*) (id1), (char*) (id2), sizeof(ddhcp_node_id))
 
@@ -24,17 +30,32 @@ enum ddhcp_block_state {
   DDHCP_BLOCKED
 };
 
+#define DDHCP_BLOCK_STATES (DDHCP_BLOCKED + 1)
+
+/**
+ * Per block metadata. The state and the timeout of a block are hot fields,
+ * they are kept in packed arrays of its block table page, see block_state()
+ * and block_timeout().
+ */
 struct ddhcp_block {
   uint32_t index;
-  enum ddhcp_block_state state;
   struct in_addr subnet;
   uint8_t  subnet_len;
   ddhcp_node_id node_id;
   struct in6_addr owner_address;
-  time_t timeout;
+  // Scheduled with the timeout iff state is neither FREE nor BLOCKED.
+  timer_node timeout_node;
   uint8_t claiming_counts;
   // Only iff state is equal to CLAIMED lease_block is not equal to NULL.
   struct dhcp_lease* addresses;
+  // Bitmap of FREE leases, it shares a lease slab slot with addresses.
+  uint64_t* lease_map;
+  // Number of leases in each dhcp_lease_state, valid iff addresses is set.
+  uint16_t leases_free;
+  uint16_t leases_offered;
+  uint16_t leases_leased;
+  // Entry in the list of blocks in state OURS.
+  struct list_head owned_list;
 };
 typedef struct ddhcp_block ddhcp_block;
 
@@ -44,6 +65,9 @@ struct ddhcp_block_list {
 };
 typedef struct ddhcp_block_list ddhcp_block_list;
 
+// Number of words in the lease_map of a block with len leases.
+#define LEASE_MAP_WORDS(len) (((uint32_t) (len) + 63) / 64)
+
 // DHCP structures
 
 enum dhcp_lease_state {
@@ -52,11 +76,16 @@ enum dhcp_lease_state {
   LEASED,
 };
 
+#define DHCP_LEASE_STATES (LEASED + 1)
+
 struct dhcp_lease {
   uint8_t chaddr[16];
   enum dhcp_lease_state state;
   uint32_t xid;
   time_t lease_end;
+  // Scheduled with lease_end iff state is not FREE.
+  timer_node expiry_node;
+  struct ddhcp_block* block;
 };
 typedef struct dhcp_lease dhcp_lease;
 
@@ -73,6 +102,38 @@ struct dhcp_option_list {
 };
 typedef struct dhcp_option_list dhcp_option_list;
 
+// Maximal length of the encoded options of a reply, taken from the store.
+#define DHCP_OPTION_BLOB_SIZE 1024
+
+// Number of parameter request lists with cached encoded options.
+#define DHCP_OPTION_BLOBS 16
+
+/**
+ * The encoded options of the store, which answer one parameter request list.
+ */
+struct dhcp_option_blob {
+  uint32_t hash;
+  uint8_t prl_len;
+  uint8_t prl[255];
+  uint16_t len;
+  uint8_t data[DHCP_OPTION_BLOB_SIZE];
+};
+typedef struct dhcp_option_blob dhcp_option_blob;
+
+/**
+ * The configured dhcp options, as list of dhcp_option_list entries and indexed
+ * by code. A zero initialized store with initialized list is empty.
+ */
+struct dhcp_option_store {
+  struct list_head list;
+  dhcp_option* table[256];
+  // Dropped whenever an option of the store changes.
+  dhcp_option_blob blobs[DHCP_OPTION_BLOBS];
+  uint8_t num_blobs;
+  uint8_t next_blob;
+};
+typedef struct dhcp_option_store dhcp_option_store;
+
 enum dhcp_option_code {
   // RFC 2132
   DHCP_CODE_PAD = 0,
@@ -98,7 +159,10 @@ struct ddhcp_config {
   uint16_t block_timeout;
   uint16_t tentative_timeout;
   uint8_t block_size;
-  uint8_t spare_blocks_needed;
+  uint32_t spare_blocks_needed;
+  // Announce blocks as runs or bitmaps, when this is smaller. Off by
+  // default, nodes without support drop these messages.
+  uint8_t compact_claims;
   struct in_addr prefix;
   uint8_t prefix_len;
 
@@ -108,11 +172,36 @@ struct ddhcp_config {
   unsigned int claiming_blocks_amount;
   ddhcp_block_list claiming_blocks;
 
+  // Index of blocks in state DDHCP_FREE.
+  freemap free_blocks;
+
+  // Timeouts of all blocks which are neither FREE nor BLOCKED.
+  timer_heap block_timeouts;
+
+  // Ends of all leases which are not FREE.
+  timer_heap lease_timeouts;
+
+  // Leases which are not FREE by chaddr and by chaddr and xid.
+  lease_index lease_clients;
+  lease_index lease_requests;
+
+  // Slots for the lease map and lease array of a block.
+  slab lease_slab;
+
+  // Blocks in state DDHCP_OURS.
+  struct list_head owned_blocks;
+  uint32_t num_owned_blocks;
+
+  // Number of blocks in each state and of leases in each state
+  // of our blocks, for reports which must not walk the blocks.
+  uint32_t num_blocks[DDHCP_BLOCK_STATES];
+  uint32_t num_leases[DHCP_LEASE_STATES];
+
   // DHCP packets for later use.
-  struct dhcp_packet_list dhcp_packet_cache;
+  dhcp_cache dhcp_packet_cache;
 
   // DHCP Options
-  dhcp_option_list options;
+  dhcp_option_store options;
 
   // Network
   int mcast_socket;
@@ -129,6 +218,8 @@ struct ddhcp_config {
 
   // DHCP
   uint16_t dhcp_port;
+  // Outgoing datagrams of the current event loop round.
+  txqueue tx_queue;
 };
 typedef struct ddhcp_config ddhcp_config;
 